@@ -2,6 +2,7 @@
 #define ENABLE_DEBUG 1
 #include "debug.h"
 #include "csp.h"
+#include "csp_pt.h"
 
 extern long random(void);
 
@@ -20,6 +21,9 @@ struct packet {
 	unsigned char data[64];
 };
 
+// Packets live in a pool, only their pointers pass through the channels.
+CHANNEL_POOL_STATIC(packets, struct packet, PLEXER_COUNT * 2);
+
 static const char *packet_data_table[] = {
 	"packet_1", "packet_2", "packet_3", "packet_4", "packet_5",
 };
@@ -44,22 +48,20 @@ void *packet_plexer(void *args, channel *c) {
 	}
 	DEBUG("%s: Streams received.\n", __func__);
 
-	struct packet p = {-1, {0}};
 	while (true) {
-		channel_recv(c, &p); // Get packet
-		DEBUG("%s: Package received: {%d, %s}\n", __func__, p.id, p.data);
-		// Verify packet
-		if (p.id == -1) {
-			// -1 is close everyone.
+		struct packet *p = channel_recv_block(c); // Get packet
+		// The channel was closed and every packet received, let the handlers finish theirs and stop.
+		if (!p) {
 			for (size_t i = 0; i != stream_count; ++i) {
-				channel_send(streams[i], &p, sizeof (p));
+				channel_close_drain(streams[i]);
 			}
 			break;
 		}
-		if ((size_t)p.id >= stream_count) { goto defer; }
-		// Pass it along
-		DEBUG("%s: Sending on channel %p\n", __func__, ((void*){0} = &streams[p.id]));
-		channel_send(streams[p.id], &p, sizeof(p));
+		DEBUG("%s: Package received: {%d, %s}\n", __func__, p->id, p->data);
+		if ((size_t)p->id >= stream_count) { channel_pool_free(&packets, p); goto defer; }
+		// Pass it along, the handler owns the packet from here.
+		DEBUG("%s: Sending on channel %p\n", __func__, ((void*){0} = &streams[p->id]));
+		channel_send_block(streams[p->id], p);
 		DEBUG("%s: Package sent to handler.\n", __func__);
 	}
 	DEBUG("%s: Finished plexing packets.\n", __func__);
@@ -70,27 +72,36 @@ defer:
 	return nullptr;
 }
 
-static void *packet_handler(void *args, channel *c)
+// Handlers are stackless, see csp_pt.h: They share the stack of one dispatcher thread and keep their state here.
+struct handler {
+	csp_pt pt;
+	struct packet *p;
+};
+
+static int packet_handler(csp_pt *pt)
 {
-	(void)args;
+	struct handler *const h = container_of(pt, struct handler, pt);
+	CSP_PT_BEGIN(pt);
 
-	struct packet p = {0};
 	while (true) {
-		channel_recv(c, &p);
-		printf("%s ID %d: Received packet { %d, %s }\n", __func__, thread_getpid(), p.id, p.data);
-		if (p.id == -1) { break; }
+		CSP_PT_RECV(pt, pt->params.c, &h->p);
+		if (!csp_pt_bytes(pt)) { break; } // Closed and drained.
+		printf("%s %p: Received packet { %d, %s }\n", __func__, (void *)pt, h->p->id, h->p->data);
+		channel_pool_free(&packets, h->p);
 	}
 
-	// HALT(__func__);
-	DEBUG("%s:%zu: Thread %d terminated.\n", __func__, __LINE__, thread_getpid());
-	channel_close(c);
-	return nullptr;
+	DEBUG("%s:%zu: Handler %p terminated.\n", __func__, __LINE__, (void *)pt);
+	channel_close(pt->params.c);
+	csp_waitgroup_done(pt->params.args);
+	CSP_PT_END(pt);
 }
 
-static char procs_stacks[PLEXER_COUNT][THREAD_STACKSIZE_CSP] = {0};
+CSP_PT_DISPATCHER_STATIC(handler_dispatcher, PLEXER_COUNT);
+static struct handler handler_procs[PLEXER_COUNT] = {0};
 int csp_plexer(void) {
 	static channel c = {0};
 	c = channel_make(&c, 1);
+	channel_pool_make_static(packets);
 
 	MAYBE_UNUSED
 	csp_ctx *plexer = GO(packet_plexer, nullptr, &c);
@@ -100,7 +111,8 @@ int csp_plexer(void) {
 
 	static channel streams[PLEXER_COUNT] = {0};
 	static channel *streams_ptr[PLEXER_COUNT] = {0};
-	csp_ctx *procs[PLEXER_COUNT] = {0};
+	static csp_waitgroup handlers = {0};
+	csp_pt_dispatcher_make_static(handler_dispatcher);
 	for (size_t i = 0; i != PLEXER_COUNT; ++i) {
 		streams[i] = channel_make(&streams[i], 1);
 		streams_ptr[i] = &streams[i];
@@ -108,35 +120,29 @@ int csp_plexer(void) {
 		channel_send(&c, &streams_ptr[i], sizeof (streams_ptr[i]));
 		DEBUG("%s: Stream %p sent.\n", __func__, (void*){0} = &streams[i]);
 		// For loops don't create new objects, need to have objects created somewhere else.
-		procs[i] = csp_obj(procs_stacks[i], packet_handler, &streams[i], nullptr);
+		csp_waitgroup_add(&handlers, 1);
+		GO_PT(&handler_dispatcher, &handler_procs[i].pt, packet_handler, &streams[i], &handlers);
 	}
 	DEBUG("%s: Procs created, streams sent.\n", __func__);
 
-	struct packet p = { -1, {0}};
-
 	// while (true) {
 	for (size_t count = 0; count != packet_table_count*PLEXER_COUNT; ++count) {
-		p.id = ((unsigned long)random() % PLEXER_COUNT);
+		struct packet *p = channel_pool_alloc(&packets);
+		p->id = ((unsigned long)random() % PLEXER_COUNT);
 		long packet_choice = (unsigned long) random() % packet_table_count;
-		for (size_t i = 0; i != packet_strlen; ++i) { p.data[i] = (const unsigned char)packet_data_table[packet_choice][i]; }
-		channel_send(&c, &p, sizeof (p));
-		DEBUG("%s: Package {%d, %s} sent to plexer.\n", __func__, p.id, p.data);
+		for (size_t i = 0; i != packet_strlen; ++i) { p->data[i] = (const unsigned char)packet_data_table[packet_choice][i]; }
+		DEBUG("%s: Package {%d, %s} sent to plexer.\n", __func__, p->id, p->data);
+		channel_send_block(&c, p);
 	}
 	DEBUG("%s: Packages sent.\n", __func__);
 	// HALT(__func__);
 
-	struct packet end = { -1, {0}};
-	channel_send(&c, &end, sizeof (end));
+	// The plexer still gets every packet sent, then sees the channel closed.
+	channel_close_drain(&c);
 
-	while (true) {
-		size_t count = 0;
-		for (; count != PLEXER_COUNT; ++count) {
-			if (csp_running(procs[count]) == false) {
-				break;
-			}
-		}
-		if (count == PLEXER_COUNT) { break; }
-	}
+	// Sleeps until every handler returned.
+	csp_waitgroup_wait(&handlers);
+	csp_pt_dispatcher_close(&handler_dispatcher);
 
 	DEBUG("%s:%zu: Thread %d terminated.\n", __func__, __LINE__, thread_getpid());
 	return 0;
@@ -45,30 +45,27 @@ job_func tasks[] = {
 static constexpr size_t nTasks = sizeof (tasks) / sizeof (*tasks);
 
 static constexpr size_t nWorkers = 2;
-static channel jobs[nWorkers] = {0};
-static channel results[nWorkers] = {0};
+// One job channel and one result channel shared by every worker, see channel_set_mpmc.
+static channel jobs = {0};
+static channel results = {0};
+static channel *worker_channels[] = { &jobs, &results };
 
-static csp_ctx *ctxs[nWorkers] = {0};
+static csp_waitgroup workers = {0};
 
-static void *jobber(void *args, channel **channels)
+static void *jobber(MAYBE_UNUSED void *args, channel **channels)
 {
 	DEBUG_PUTS(__func__);
 	DEBUG("Thread %zu\n", thread_getpid());
 
 	channel *const job_c = channels[0];
-	// channel_send(job_c, &(const int){42}, sizeof (const int));
 	channel *const result_c = channels[1];
-	// channel_send(result_c, &(const int){69}, sizeof (const int));
 	DEBUG("%s Channel pointers: %p %p\n", __func__, (void*)job_c, (void*)result_c);
 
-	const size_t jobs_n = *((size_t *){0} = args);
-	DEBUG("Jobs: %zu\n", jobs_n);
-
-	channel_send(job_c, &jobs_n, sizeof (jobs_n));
-
-	for (size_t i = 0; i != jobs_n; ++i) {
+	// Whichever worker is free takes the next job, a null job stops the worker.
+	while (true) {
 		job_func job = 0;
 		channel_recv(job_c, &job);
+		if (!job) { break; }
 		MAYBE_UNUSED
 		int retval = job(nullptr);
 		channel_send(result_c, &retval, sizeof (retval));
@@ -79,41 +76,34 @@ static void *jobber(void *args, channel **channels)
 
 int main(void) {
 	static char stacks[nWorkers][THREAD_STACKSIZE_CSP] = {0};
+	jobs = channel_make(&jobs, 1);
+	channel_set_mpmc(&jobs);
+	results = channel_make(&results, 1);
+	channel_set_mpmc(&results);
 	for (size_t i = 0; i != nWorkers; ++i) {
-		jobs[i] = channel_make(&jobs[i], 1);
-		results[i] = channel_make(&results[i], 1);
-		ctxs[i] = csp_obj(stacks[i], jobber, (channel*)((channel*[nWorkers]){&jobs[i], &results[i]}), &(size_t){nTasks});
-		DEBUG("%s Channel pointers: %p %p\n", __func__, (void*)&jobs[i], (void*)&results[i]);
+		csp_obj_wg(&workers, stacks[i], jobber, (channel*)worker_channels, nullptr);
 	}
-	// ctxs[0] = GO(jobber, &(size_t){nTasks}, (channel*)((channel*[nWorkers]){&jobs[0], &results[0]}));
-	// ctxs[1] = GO(jobber, &(size_t){nTasks}, (channel*)((channel*[nWorkers]){&jobs[1], &results[1]}));
+	DEBUG("%s Channel pointers: %p %p\n", __func__, (void*)&jobs, (void*)&results);
 
 	DEBUG_PUTS("Main");
 
-	size_t nJobs = 0;
-	size_t temp = 0;
-	channel_recv(&jobs[0], &temp);
-	assert(temp == 3);
-	nJobs += temp;
-
-	channel_recv(&jobs[1], &temp);
-	assert(temp == 3);
-	nJobs += temp;
-
-	channel_send(&jobs[0], &tasks[0], sizeof (*tasks));
-	channel_send(&jobs[0], &tasks[1], sizeof (*tasks));
-	channel_send(&jobs[0], &tasks[2], sizeof (*tasks));
-
-	channel_send(&jobs[1], &tasks[0], sizeof (*tasks));
-	channel_send(&jobs[1], &tasks[1], sizeof (*tasks));
-	channel_send(&jobs[1], &tasks[2], sizeof (*tasks));
+	// nWorkers rounds of the tasks, shared out to whichever worker is free, not one round per worker.
+	const size_t nJobs = nWorkers * nTasks;
+	for (size_t i = 0; i != nJobs; ++i) {
+		channel_send(&jobs, &tasks[i % nTasks], sizeof (*tasks));
+	}
 
 	for (size_t i = 0; i != nJobs; ++i) {
 		int retval = -1;
-		channel_recv(&results[i % nWorkers], &retval);
+		channel_recv(&results, &retval);
 		DEBUG("Retval for job %zu: %d\n", i, retval);
 	}
 
+	for (size_t i = 0; i != nWorkers; ++i) {
+		channel_send(&jobs, &(job_func){0}, sizeof (job_func));
+	}
+	csp_waitgroup_wait(&workers);
+
 	DEBUG_PUTS("Finished");
 	return 0;
 }
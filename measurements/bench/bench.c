@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @{
+ *
+ * @file
+ * @brief       Benchmark harness: Repetitions, statistics and record output.
+ *
+ * @author      Jonathan L. Claudius <jcl005@uit.no>
+ *
+ * @}
+ */
+
+#include "bench.h"
+
+#include "csp.h"
+#include "kernel_defines.h"
+#include "ztimer.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Build configuration every record carries, so results from different builds can sit in one file.
+#ifdef TSRB
+#define BENCH_TSRB 1
+#else
+#define BENCH_TSRB 0
+#endif
+#define BENCH_RR IS_USED(MODULE_SCHED_ROUND_ROBIN)
+#define BENCH_CSTD (__STDC_VERSION__)
+
+static uint32_t bench_isqrt(uint64_t x)
+{
+	uint64_t root = 0;
+	uint64_t bit = UINT64_C(1) << 62;
+	while (bit > x) { bit >>= 2; }
+	for (; bit; bit >>= 2) {
+		if (x >= root + bit) {
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else { root >>= 1; }
+	}
+	return (uint32_t)root;
+}
+
+bench_result bench_summarize(uint32_t samples[], const unsigned n)
+{
+	if (!n) { return (bench_result){ 0 }; }
+	// Insertion sort, there are only a handful of repetitions.
+	for (unsigned i = 1; i != n; ++i) {
+		const uint32_t v = samples[i];
+		unsigned j = i;
+		for (; j && samples[j - 1] > v; --j) { samples[j] = samples[j - 1]; }
+		samples[j] = v;
+	}
+	uint64_t sum = 0;
+	for (unsigned i = 0; i != n; ++i) { sum += samples[i]; }
+	const uint32_t mean = (uint32_t)(sum / n);
+	uint64_t squares = 0;
+	for (unsigned i = 0; i != n; ++i) {
+		const int64_t d = (int64_t)samples[i] - mean;
+		squares += (uint64_t)(d * d);
+	}
+	return (bench_result){
+		.reps = n,
+		.median = (n % 2) ? samples[n / 2] : (uint32_t)(((uint64_t)samples[n / 2 - 1] + samples[n / 2]) / 2),
+		.min = samples[0],
+		.max = samples[n - 1],
+		.mean = mean,
+		.stddev = bench_isqrt(squares / n),
+	};
+}
+
+bench_result bench_run(const bench_scenario s[static 1])
+{
+	uint32_t samples[BENCH_REPS];
+	if (s->setup) { s->setup(); }
+	for (unsigned i = 0; i != BENCH_WARMUP; ++i) { s->run(s->iters); }
+	for (unsigned i = 0; i != BENCH_REPS; ++i) {
+		const ztimer_now_t start = ztimer_now(ZTIMER_USEC);
+		s->run(s->iters);
+		samples[i] = ztimer_now(ZTIMER_USEC) - start;
+	}
+	if (s->teardown) { s->teardown(); }
+	return bench_summarize(samples, BENCH_REPS);
+}
+
+bench_hist *bench_latency_hist;
+
+void bench_latency(const bench_scenario s[static 1], bench_hist h[static 1])
+{
+	bench_hist_clear(h);
+	if (s->setup) { s->setup(); }
+	for (unsigned i = 0; i != BENCH_WARMUP; ++i) { s->run(s->iters); }
+	bench_latency_hist = h;
+	for (unsigned i = 0; i != BENCH_REPS; ++i) { s->run(s->iters); }
+	bench_latency_hist = NULL;
+	if (s->teardown) { s->teardown(); }
+}
+
+static bool bench_first;
+
+void bench_section_begin(const char *const section, const char *const columns)
+{
+	printf("bench: %s begin\n", section);
+	bench_first = true;
+#ifdef BENCH_JSON
+	(void)columns;
+	puts("[");
+#else
+	printf("scenario,buffered,tsrb,rr,cstd,bufsize,%s\n", columns);
+#endif
+}
+
+void bench_section_end(const char *const section)
+{
+#ifdef BENCH_JSON
+	puts("\n]");
+#endif
+	printf("bench: %s end\n", section);
+}
+
+// The fields every record starts with: Scenario and build configuration.
+static void bench_print_head(const bench_scenario s[static 1])
+{
+	char buffered[8] = "";
+	if (s->buffered >= 0) { snprintf(buffered, sizeof (buffered), "%d", s->buffered); }
+#ifdef BENCH_JSON
+	printf("%s{\"scenario\":\"%s\",\"buffered\":%s,\"tsrb\":%d,\"rr\":%d,\"cstd\":%ld,\"bufsize\":%u,",
+		(bench_first) ? "" : ",\n", s->name, (s->buffered >= 0) ? buffered : "null",
+		BENCH_TSRB, BENCH_RR, (long)BENCH_CSTD, (unsigned)CHANNEL_BUFSIZE);
+#else
+	printf("%s,%s,%d,%d,%ld,%u,", s->name, buffered, BENCH_TSRB, BENCH_RR, (long)BENCH_CSTD, (unsigned)CHANNEL_BUFSIZE);
+#endif
+	bench_first = false;
+}
+
+void bench_print(const bench_scenario s[static 1], const bench_result r[static 1])
+{
+	const uint32_t ns_per_op = (uint32_t)((uint64_t)r->median * 1000 / ((s->iters) ? s->iters : 1));
+	bench_print_head(s);
+#ifdef BENCH_JSON
+	printf("\"iters\":%u,\"reps\":%u,"
+		"\"median_us\":%" PRIu32 ",\"min_us\":%" PRIu32 ",\"max_us\":%" PRIu32 ",\"mean_us\":%" PRIu32 ","
+		"\"stddev_us\":%" PRIu32 ",\"median_ns_per_op\":%" PRIu32 "}",
+		s->iters, r->reps, r->median, r->min, r->max, r->mean, r->stddev, ns_per_op);
+#else
+	printf("%u,%u,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n",
+		s->iters, r->reps, r->median, r->min, r->max, r->mean, r->stddev, ns_per_op);
+#endif
+}
+
+void bench_print_latency(const bench_scenario s[static 1], const bench_hist h[static 1])
+{
+	const uint32_t p50 = bench_hist_quantile(h, 50, 100);
+	const uint32_t p90 = bench_hist_quantile(h, 90, 100);
+	const uint32_t p99 = bench_hist_quantile(h, 99, 100);
+	const uint32_t p999 = bench_hist_quantile(h, 999, 1000);
+	bench_print_head(s);
+#ifdef BENCH_JSON
+	printf("\"unit\":\"%s\",\"count\":%" PRIu32 ",\"min\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p90\":%" PRIu32 ","
+		"\"p99\":%" PRIu32 ",\"p999\":%" PRIu32 ",\"max\":%" PRIu32 "}",
+		BENCH_UNIT, h->total, h->min, p50, p90, p99, p999, h->max);
+#else
+	printf("%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n",
+		BENCH_UNIT, h->total, h->min, p50, p90, p99, p999, h->max);
+#endif
+}
+
+void bench_print_throughput(const bench_scenario s[static 1], const size_t msg_size, const bench_result r[static 1], const uint32_t switches)
+{
+	const uint64_t msgs_per_s = (r->median) ? (uint64_t)s->iters * 1000000 / r->median : 0;
+	const uint64_t bytes_per_s = msgs_per_s * msg_size;
+	// Switches count for the warmup too, every message bench_run sent.
+	const uint64_t msgs = (uint64_t)(BENCH_WARMUP + BENCH_REPS) * s->iters;
+	const uint32_t centi_switches = (msgs) ? (uint32_t)((uint64_t)switches * 100 / msgs) : 0;
+	const uint64_t mb = bytes_per_s / 1000000;
+	const unsigned centi_mb = (unsigned)(bytes_per_s % 1000000 / 10000);
+	bench_print_head(s);
+#ifdef BENCH_JSON
+	printf("\"msg_size\":%zu,\"iters\":%u,\"median_us\":%" PRIu32 ",\"msgs_per_s\":%" PRIu64 ","
+		"\"mb_per_s\":%" PRIu64 ".%02u,\"switches_per_msg\":%" PRIu32 ".%02" PRIu32 "}",
+		msg_size, s->iters, r->median, msgs_per_s, mb, centi_mb, centi_switches / 100, centi_switches % 100);
+#else
+	printf("%zu,%u,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ".%02u,%" PRIu32 ".%02" PRIu32 "\n",
+		msg_size, s->iters, r->median, msgs_per_s, mb, centi_mb, centi_switches / 100, centi_switches % 100);
+#endif
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @{
+ *
+ * @file bench.h
+ * @brief       Benchmark harness for the measurements.
+ *				A scenario is set up once, run BENCH_WARMUP times untimed and BENCH_REPS times timed,
+ *				then torn down. Each timed repetition does the scenario's iterations in one go, with the
+ *				clock read around it, so the per operation cost needs no loop overhead correction:
+ *				The noop scenario shows what the loop itself costs.
+ *				Scenarios marked for latency also run once more with every operation they wrap in BENCH_LATENCY
+ *				timed on its own into a histogram, see hist.h, for the percentiles the totals hide.
+ *				Results are CSV or, with BENCH_JSON, JSON records carrying the build configuration,
+ *				in sections between "bench: <section> begin" and "bench: <section> end" lines for the Makefile to pick out.
+ *
+ * @author      Jonathan L. Claudius <jaylcypher@github.com>
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hist.h"
+#include "ztimer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef BENCH_WARMUP
+#define BENCH_WARMUP 2
+#endif
+#ifndef BENCH_REPS
+#define BENCH_REPS 10
+#endif
+
+// Record sections and their CSV columns past the scenario and build configuration.
+#define BENCH_SECTION_RUN "run"
+#define BENCH_SECTION_RUN_COLUMNS "iters,reps,median_us,min_us,max_us,mean_us,stddev_us,median_ns_per_op"
+#define BENCH_SECTION_LATENCY "latency"
+#define BENCH_SECTION_LATENCY_COLUMNS "unit,count,min,p50,p90,p99,p999,max"
+#define BENCH_SECTION_SWEEP "sweep"
+#define BENCH_SECTION_SWEEP_COLUMNS "msg_size,iters,median_us,msgs_per_s,mb_per_s,switches_per_msg"
+
+// Clock of the latencies, in BENCH_UNIT. Define both for a finer one, like a cycle counter.
+#ifndef BENCH_NOW
+#define BENCH_NOW() ztimer_now(ZTIMER_USEC)
+#define BENCH_UNIT "us"
+#endif
+
+// Set while bench_latency runs a scenario.
+extern bench_hist *bench_latency_hist;
+
+// Runs op, timing it into the latency histogram if one is set.
+#define BENCH_LATENCY(op) \
+	do { \
+		if (bench_latency_hist) { \
+			const uint32_t bench_start_ = BENCH_NOW(); \
+			op; \
+			bench_hist_add(bench_latency_hist, BENCH_NOW() - bench_start_); \
+		} \
+		else { op; } \
+	} while (0)
+
+typedef struct bench_scenario bench_scenario;
+struct bench_scenario {
+	const char *name;
+	int buffered;	 // 1 or 0 for the channel scenarios, -1 where it does not apply.
+	unsigned iters;	 // Operations per repetition.
+	void (*setup)(void);	 // Optional, untimed.
+	void (*run)(unsigned iters);
+	void (*teardown)(void);	 // Optional, untimed.
+	bool latency;	 // Run wraps its operations in BENCH_LATENCY, see bench_latency.
+};
+
+typedef struct bench_result bench_result;
+struct bench_result {
+	unsigned reps;
+	uint32_t median;	 // Microseconds per repetition.
+	uint32_t min;
+	uint32_t max;
+	uint32_t mean;
+	uint32_t stddev;
+};
+
+// Sorts the n samples and sums them up.
+bench_result bench_summarize(uint32_t samples[], unsigned n);
+bench_result bench_run(const bench_scenario s[static 1]);
+// Runs the scenario as many times as bench_run, with every operation timed into h.
+void bench_latency(const bench_scenario s[static 1], bench_hist h[static 1]);
+
+// Record output: A section begins, gets one record per scenario, and ends.
+void bench_section_begin(const char *section, const char *columns);
+void bench_section_end(const char *section);
+void bench_print(const bench_scenario s[static 1], const bench_result r[static 1]);
+void bench_print_latency(const bench_scenario s[static 1], const bench_hist h[static 1]);
+// Throughput at the median of a bench_run of msg_size byte messages, which took switches context switches.
+void bench_print_throughput(const bench_scenario s[static 1], size_t msg_size, const bench_result r[static 1], uint32_t switches);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_H */
+/** @} */
@@ -0,0 +1,73 @@
+# Compares two run sections of make bench in CSV, a baseline and a new run:
+#   awk -f compare.awk [-v threshold=3] [-v sigmas=2] baseline.csv new.csv
+# A scenario counts as faster or slower once its median moved by more than the noise of both runs,
+# sigmas standard deviations of the difference, and by more than threshold percent of the baseline.
+# Everything below either is reported as same. Exits with 1 on any regression if strict is set.
+
+BEGIN {
+	FS = ","
+	if (threshold == "") { threshold = 3 }
+	if (sigmas == "") { sigmas = 2 }
+}
+
+# The header of each file names the columns.
+FNR == 1 {
+	delete col
+	for (i = 1; i <= NF; ++i) { col[$i] = i }
+	if (!("median_us" in col) || !("stddev_us" in col)) {
+		printf "compare: %s is not a run section of make bench in CSV\n", FILENAME > "/dev/stderr"
+		malformed = 1
+		exit 2
+	}
+	next
+}
+
+{
+	key = $col["scenario"] "," $col["buffered"]
+	config = "tsrb=" $col["tsrb"] " rr=" $col["rr"] " cstd=" $col["cstd"]
+	if ("bufsize" in col) { config = config " bufsize=" $col["bufsize"] }
+}
+
+# The baseline.
+FNR == NR {
+	base_median[key] = $col["median_us"]
+	base_stddev[key] = $col["stddev_us"]
+	base_config = config
+	next
+}
+
+{
+	if (!header++) {
+		if (config != base_config) { printf "Note: Baseline built with %s, new run with %s\n", base_config, config }
+		printf "%-24s %-8s %12s %12s %9s %9s  %s\n", "scenario", "buffered", "base_us", "new_us", "speedup", "change", "verdict"
+	}
+	new_median = $col["median_us"]
+	if (!(key in base_median)) {
+		printf "%-24s %-8s %12s %12d %9s %9s  %s\n", $col["scenario"], $col["buffered"], "-", new_median, "-", "-", "new"
+		next
+	}
+	seen[key] = 1
+	base = base_median[key]
+	diff = new_median - base
+	noise = sigmas * sqrt(base_stddev[key] ^ 2 + $col["stddev_us"] ^ 2)
+	verdict = "same"
+	if ((diff > 0 ? diff : -diff) > noise && (diff > 0 ? diff : -diff) * 100 > threshold * base) {
+		verdict = (diff < 0) ? "faster" : "SLOWER"
+		if (diff > 0) { ++regressions }
+		else { ++improvements }
+	}
+	printf "%-24s %-8s %12d %12d %8.2fx %+8.1f%%  %s\n", $col["scenario"], $col["buffered"], base, new_median,
+		new_median ? base / new_median : 0, base ? diff * 100 / base : 0, verdict
+}
+
+END {
+	# exit in a rule still runs END, skip the summary for a malformed file.
+	if (malformed) { exit 2 }
+	for (key in base_median) {
+		if (key in seen) { continue }
+		split(key, k, ",")
+		printf "%-24s %-8s %12d %12s %9s %9s  %s\n", k[1], k[2], base_median[key], "-", "-", "-", "gone"
+	}
+	printf "%d faster, %d slower beyond %s%% and %s sigma\n", improvements, regressions, threshold, sigmas
+	if (strict && regressions) { exit 1 }
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @{
+ *
+ * @file
+ * @brief       Log-scale histogram percentiles.
+ *
+ * @author      Jonathan L. Claudius <jcl005@uit.no>
+ *
+ * @}
+ */
+
+#include "hist.h"
+
+void bench_hist_clear(bench_hist h[static 1])
+{ *h = (bench_hist){ 0 }; }
+
+// The largest value counted in bucket i.
+static uint32_t bench_hist_top(const unsigned i)
+{
+	if (i < BENCH_HIST_SUBS) { return i; }
+	const unsigned shift = i / BENCH_HIST_SUBS - 1;
+	const uint64_t mantissa = i % BENCH_HIST_SUBS + BENCH_HIST_SUBS;
+	return (uint32_t)(((mantissa + 1) << shift) - 1);
+}
+
+uint32_t bench_hist_quantile(const bench_hist h[static 1], const uint32_t num, const uint32_t den)
+{
+	if (!h->total || !den) { return 0; }
+	// The rank of the sample, at least the first.
+	uint64_t rank = ((uint64_t)h->total * num + den - 1) / den;
+	if (!rank) { rank = 1; }
+	uint64_t seen = 0;
+	for (unsigned i = 0; i != BENCH_HIST_BUCKETS; ++i) {
+		seen += h->counts[i];
+		if (seen >= rank) {
+			// Nothing counted is beyond the largest sample.
+			const uint32_t top = bench_hist_top(i);
+			return (top < h->max) ? top : h->max;
+		}
+	}
+	return h->max;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @{
+ *
+ * @file hist.h
+ * @brief       Log-scale histogram of 32 bit samples, for latency percentiles.
+ *				Values below BENCH_HIST_SUBS are counted exactly. Above, every power of two is split into
+ *				BENCH_HIST_SUBS buckets, so a percentile is off by at most 1/BENCH_HIST_SUBS of its value,
+ *				12.5% with the default 3 sub-bucket bits, in a fixed 960 bytes whatever the range.
+ *				Adding a sample is a bit scan, a shift and an increment, cheap enough to do per operation.
+ *
+ * @author      Jonathan L. Claudius <jaylcypher@github.com>
+ */
+
+#ifndef BENCH_HIST_H
+#define BENCH_HIST_H
+
+#include <stdint.h>
+
+#include "bitarithm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef BENCH_HIST_SUB_BITS
+#define BENCH_HIST_SUB_BITS 3
+#endif
+#define BENCH_HIST_SUBS (1u << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_BUCKETS ((32 - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUBS)
+
+typedef struct bench_hist bench_hist;
+struct bench_hist {
+	uint32_t counts[BENCH_HIST_BUCKETS];
+	uint32_t total;
+	uint32_t min;
+	uint32_t max;
+};
+
+static inline unsigned bench_hist_bucket(const uint32_t v)
+{
+	if (v < BENCH_HIST_SUBS) { return v; }
+	// The top BENCH_HIST_SUB_BITS + 1 bits, the leading one picking the power of two.
+	const unsigned shift = bitarithm_msb(v) - BENCH_HIST_SUB_BITS;
+	return (shift + 1) * BENCH_HIST_SUBS + (unsigned)(v >> shift) - BENCH_HIST_SUBS;
+}
+
+static inline void bench_hist_add(bench_hist h[static 1], const uint32_t v)
+{
+	++h->counts[bench_hist_bucket(v)];
+	if (!h->total++ || v < h->min) { h->min = v; }
+	if (v > h->max) { h->max = v; }
+}
+
+void bench_hist_clear(bench_hist h[static 1]);
+// The value at or below which num/den of the samples are, rounded up to the top of its bucket.
+// E.g. p99.9 is bench_hist_quantile(h, 999, 1000). 0 without samples.
+uint32_t bench_hist_quantile(const bench_hist h[static 1], uint32_t num, uint32_t den);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_HIST_H */
+/** @} */
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @{
+ *
+ * @file
+ * @brief       Benchmark suite: The scenarios of the api, simple_work and ipc_pingpong_csp measurements,
+ *				run by the harness in bench.h against the RIOT thread messaging they compete with.
+ *
+ * @author      Jonathan L. Claudius <jcl005@uit.no>
+ *
+ * @}
+ */
+
+#include "bench.h"
+#include "csp.h"
+#include "csp_coro.h"
+#include "msg.h"
+#include "thread.h"
+
+#include <stddef.h>
+
+#ifdef BENCH_SWEEP
+#include "schedstatistics.h"
+#endif
+
+#define BENCH_MSG_STOP UINT32_MAX
+
+// The other side of every scenario, higher priority than main so it runs as soon as it can.
+static char bench_partner_stack[THREAD_STACKSIZE_MAIN];
+static kernel_pid_t bench_partner_pid;
+static channel bench_c;
+// Largest message, of the sweep.
+#define BENCH_SIZE_MAX (4 * CHANNEL_BUFSIZE)
+static char bench_data[BENCH_SIZE_MAX];
+
+// Fits the buffer with its data size, fits the message header of simple_work, and does not fit.
+#define BENCH_SIZE_FITS (CHANNEL_BUFSIZE - sizeof (size_t))
+#define BENCH_SIZE_SMALL (sizeof (msg_t))
+#define BENCH_SIZE_UNFITS (2 * CHANNEL_BUFSIZE)
+
+/* Partners */
+
+static void *bench_sink(void *arg, channel *c)
+{
+	(void)arg;
+	static char buffer[sizeof (bench_data)];
+	while (channel_recv(c, buffer)) { }
+	return NULL;
+}
+
+static void *bench_echo(void *arg, channel *c)
+{
+	(void)arg;
+	static char buffer[sizeof (bench_data)];
+	for (size_t n; (n = channel_recv(c, buffer)); ) {
+		if (!channel_send(c, buffer, n)) { break; }
+	}
+	return NULL;
+}
+
+static void *bench_msg_sink(void *arg)
+{
+	(void)arg;
+	msg_t m;
+	do { msg_receive(&m); } while (m.content.value != BENCH_MSG_STOP);
+	return NULL;
+}
+
+static void *bench_msg_echo(void *arg)
+{
+	(void)arg;
+	msg_t m;
+	while (1) {
+		msg_receive(&m);
+		if (m.content.value == BENCH_MSG_STOP) { break; }
+		msg_reply(&m, &m);
+	}
+	return NULL;
+}
+
+static void bench_go_partner(const bool buffered, void *(*const partner)(void *, channel *))
+{
+	bench_c = channel_make(&bench_c, buffered);
+#ifdef TSRB
+	// One sender and one receiver each way, so TSRB builds measure the lock-free ring.
+	channel_set_spsc(&bench_c);
+#endif
+	csp_obj(bench_partner_stack, partner, &bench_c, NULL);
+}
+
+static void bench_setup_sink_buffered(void) { bench_go_partner(true, bench_sink); }
+static void bench_setup_sink_unbuffered(void) { bench_go_partner(false, bench_sink); }
+static void bench_setup_echo_buffered(void) { bench_go_partner(true, bench_echo); }
+static void bench_setup_echo_unbuffered(void) { bench_go_partner(false, bench_echo); }
+
+// The partner wakes to the closed channel and, being higher priority, is gone before this returns.
+static void bench_teardown_channel(void) { channel_close(&bench_c); }
+
+static void bench_setup_msg_sink(void)
+{
+	bench_partner_pid = thread_create(bench_partner_stack, sizeof (bench_partner_stack),
+		THREAD_PRIORITY_MAIN - 1, 0, bench_msg_sink, NULL, "bench_msg");
+}
+
+static void bench_setup_msg_echo(void)
+{
+	bench_partner_pid = thread_create(bench_partner_stack, sizeof (bench_partner_stack),
+		THREAD_PRIORITY_MAIN - 1, 0, bench_msg_echo, NULL, "bench_msg");
+}
+
+static void bench_teardown_msg(void)
+{
+	msg_t m = { .content.value = BENCH_MSG_STOP };
+	msg_send(&m, bench_partner_pid);
+}
+
+/* Scenarios */
+
+static void bench_noop(unsigned iters)
+{ for (volatile unsigned i = 0; i != iters; ++i) { } }
+
+static void *bench_task(void *arg)
+{ return arg; }
+
+static void bench_go(unsigned iters)
+{ while (iters--) { GO(bench_task); } }
+
+// The same tasks on workers made once, see csp_pool.
+CSP_POOL_STATIC(bench_pool, 2, 8);
+
+static void bench_setup_pool(void)
+{ csp_pool_make_static(bench_pool); }
+
+static void bench_teardown_pool(void)
+{ csp_pool_close(&bench_pool); }
+
+static void bench_pool_dispatch(unsigned iters)
+{ while (iters--) { GO_POOL(&bench_pool, bench_task); } }
+
+static void bench_send_small(unsigned iters)
+{ while (iters--) { channel_send(&bench_c, bench_data, BENCH_SIZE_SMALL); } }
+
+static void bench_send_fits(unsigned iters)
+{ while (iters--) { channel_send(&bench_c, bench_data, BENCH_SIZE_FITS); } }
+
+static void bench_send_unfits(unsigned iters)
+{ while (iters--) { channel_send(&bench_c, bench_data, BENCH_SIZE_UNFITS); } }
+
+static void bench_pingpong(unsigned iters)
+{
+	while (iters--) {
+		BENCH_LATENCY(
+			channel_send(&bench_c, bench_data, BENCH_SIZE_SMALL);
+			channel_recv(&bench_c, bench_data)
+		);
+	}
+}
+
+#ifdef CSP_CORO
+// The round trips of channel_pingpong between two coroutines of the calling thread, see csp_coro.h.
+static csp_carrier bench_carrier;
+static csp_coro_chan bench_ping, bench_pong;
+static char bench_coro_rb[BENCH_SIZE_MAX];
+static char bench_coro_stacks[2][CSP_CORO_STACKSIZE];
+
+static void *bench_coro_ping(void *arg)
+{
+	for (unsigned iters = (unsigned)(uintptr_t)arg; iters--; ) {
+		BENCH_LATENCY(
+			csp_coro_send(&bench_ping, bench_data, BENCH_SIZE_SMALL);
+			csp_coro_recv(&bench_pong, bench_data)
+		);
+	}
+	csp_coro_close(&bench_ping);
+	return NULL;
+}
+
+static void *bench_coro_echo(void *arg)
+{
+	(void)arg;
+	char data[BENCH_SIZE_SMALL];
+	for (size_t bytes; (bytes = csp_coro_recv(&bench_ping, data)); ) { csp_coro_send(&bench_pong, data, bytes); }
+	return NULL;
+}
+
+static void bench_coro_pingpong(const bool buffered, unsigned iters)
+{
+	csp_coro_chan_make(&bench_ping, buffered ? sizeof bench_coro_rb : 0, bench_coro_rb);
+	csp_coro_chan_make(&bench_pong, 0, NULL);
+	csp_coro_obj(&bench_carrier, bench_coro_stacks[0], bench_coro_ping, NULL, (void *)(uintptr_t)iters);
+	csp_coro_obj(&bench_carrier, bench_coro_stacks[1], bench_coro_echo, NULL, NULL);
+	csp_carrier_run(&bench_carrier);
+}
+
+static void bench_coro_pingpong_buffered(unsigned iters) { bench_coro_pingpong(true, iters); }
+static void bench_coro_pingpong_unbuffered(unsigned iters) { bench_coro_pingpong(false, iters); }
+#endif
+
+static void bench_msg_send(unsigned iters)
+{
+	msg_t m = { .content.value = 0 };
+	while (iters--) { msg_send(&m, bench_partner_pid); }
+}
+
+static void bench_msg_pingpong(unsigned iters)
+{
+	msg_t m = { .content.value = 0 };
+	while (iters--) { BENCH_LATENCY(msg_send_receive(&m, &m, bench_partner_pid)); }
+}
+
+static const bench_scenario bench_scenarios[] = {
+	{ "noop", -1, 100000, NULL, bench_noop, NULL },
+	{ "go_dispatch", -1, 100, NULL, bench_go, NULL },
+	{ "pool_dispatch", -1, 1000, bench_setup_pool, bench_pool_dispatch, bench_teardown_pool },
+	{ "msg_send", -1, 1000, bench_setup_msg_sink, bench_msg_send, bench_teardown_msg },
+	{ "channel_send_small", 1, 1000, bench_setup_sink_buffered, bench_send_small, bench_teardown_channel },
+	{ "channel_send_small", 0, 1000, bench_setup_sink_unbuffered, bench_send_small, bench_teardown_channel },
+	{ "channel_send_fits", 1, 1000, bench_setup_sink_buffered, bench_send_fits, bench_teardown_channel },
+	{ "channel_send_fits", 0, 1000, bench_setup_sink_unbuffered, bench_send_fits, bench_teardown_channel },
+	{ "channel_send_unfits", 1, 100, bench_setup_sink_buffered, bench_send_unfits, bench_teardown_channel },
+	{ "channel_send_unfits", 0, 100, bench_setup_sink_unbuffered, bench_send_unfits, bench_teardown_channel },
+	{ "msg_pingpong", -1, 1000, bench_setup_msg_echo, bench_msg_pingpong, bench_teardown_msg, true },
+	{ "channel_pingpong", 1, 1000, bench_setup_echo_buffered, bench_pingpong, bench_teardown_channel, true },
+	{ "channel_pingpong", 0, 1000, bench_setup_echo_unbuffered, bench_pingpong, bench_teardown_channel, true },
+#ifdef CSP_CORO
+	{ "coro_pingpong", 1, 1000, NULL, bench_coro_pingpong_buffered, NULL, true },
+	{ "coro_pingpong", 0, 1000, NULL, bench_coro_pingpong_unbuffered, NULL, true },
+#endif
+};
+
+#ifdef BENCH_SWEEP
+/* Sweep: Throughput over message sizes and buffering, to a higher priority consumer (eager) and one
+ * at the priority of main (peer). The build sweeps the rest, see measurements/Makefile. */
+
+#ifndef BENCH_SWEEP_MSGS
+#define BENCH_SWEEP_MSGS 1000
+#endif
+
+static size_t bench_sweep_size;
+
+// A consumer at the priority of main only runs once main blocks or yields, so the buffer fills up first.
+static void *bench_sweep_peer(void *arg)
+{ return bench_sink(NULL, arg); }
+
+static void bench_sweep_setup_peer(const bool buffered)
+{
+	bench_c = channel_make(&bench_c, buffered);
+#ifdef TSRB
+	channel_set_spsc(&bench_c);
+#endif
+	bench_partner_pid = thread_create(bench_partner_stack, sizeof (bench_partner_stack),
+		THREAD_PRIORITY_MAIN, 0, bench_sweep_peer, &bench_c, "bench_peer");
+}
+
+static void bench_sweep_setup_peer_buffered(void) { bench_sweep_setup_peer(true); }
+static void bench_sweep_setup_peer_unbuffered(void) { bench_sweep_setup_peer(false); }
+
+static void bench_sweep_teardown_peer(void)
+{
+	channel_close(&bench_c);
+	while (thread_get(bench_partner_pid)) { thread_yield(); }
+}
+
+static void bench_sweep_send(unsigned iters)
+{ while (iters--) { channel_send(&bench_c, bench_data, bench_sweep_size); } }
+
+static uint32_t bench_switches(void)
+{
+	uint32_t switches = 0;
+	for (kernel_pid_t pid = KERNEL_PID_FIRST; pid <= KERNEL_PID_LAST; ++pid) { switches += sched_pidlist[pid].schedules; }
+	return switches;
+}
+
+static void bench_sweep(void)
+{
+	static const bench_scenario sweeps[] = {
+		{ "throughput_eager", 1, BENCH_SWEEP_MSGS, bench_setup_sink_buffered, bench_sweep_send, bench_teardown_channel },
+		{ "throughput_eager", 0, BENCH_SWEEP_MSGS, bench_setup_sink_unbuffered, bench_sweep_send, bench_teardown_channel },
+		{ "throughput_peer", 1, BENCH_SWEEP_MSGS, bench_sweep_setup_peer_buffered, bench_sweep_send, bench_sweep_teardown_peer },
+		{ "throughput_peer", 0, BENCH_SWEEP_MSGS, bench_sweep_setup_peer_unbuffered, bench_sweep_send, bench_sweep_teardown_peer },
+	};
+	bench_section_begin(BENCH_SECTION_SWEEP, BENCH_SECTION_SWEEP_COLUMNS);
+	for (size_t i = 0; i != ARRAY_SIZE(sweeps); ++i) {
+		// 1 byte up to several times the buffer, straddling the point where messages stop fitting.
+		for (bench_sweep_size = 1; bench_sweep_size <= BENCH_SIZE_MAX; bench_sweep_size *= 2) {
+			const uint32_t before = bench_switches();
+			const bench_result r = bench_run(&sweeps[i]);
+			bench_print_throughput(&sweeps[i], bench_sweep_size, &r, bench_switches() - before);
+		}
+	}
+	bench_section_end(BENCH_SECTION_SWEEP);
+}
+#endif
+
+int main(void)
+{
+	for (size_t i = 0; i != sizeof (bench_data); ++i) { bench_data[i] = (char)('a' + i % 26); }
+#ifdef BENCH_SWEEP
+	bench_sweep();
+	return 0;
+#endif
+	bench_section_begin(BENCH_SECTION_RUN, BENCH_SECTION_RUN_COLUMNS);
+	for (size_t i = 0; i != ARRAY_SIZE(bench_scenarios); ++i) {
+		const bench_result r = bench_run(&bench_scenarios[i]);
+		bench_print(&bench_scenarios[i], &r);
+	}
+	bench_section_end(BENCH_SECTION_RUN);
+
+	static bench_hist h;
+	bench_section_begin(BENCH_SECTION_LATENCY, BENCH_SECTION_LATENCY_COLUMNS);
+	for (size_t i = 0; i != ARRAY_SIZE(bench_scenarios); ++i) {
+		if (!bench_scenarios[i].latency) { continue; }
+		bench_latency(&bench_scenarios[i], &h);
+		bench_print_latency(&bench_scenarios[i], &h);
+	}
+	bench_section_end(BENCH_SECTION_LATENCY);
+	return 0;
+}
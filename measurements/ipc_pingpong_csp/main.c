@@ -111,9 +111,9 @@ int main(void)
 	csp_time[0] = ztimer_now(ZTIMER_USEC);
 	{
 
-		channel c = channel_make(&c);
+		channel c = channel_make(&c, 0);
 		DEBUG("address %p\n", (void*)&c);
-		GO(second_csp, &c, "pong");
+		csp_ctx *const second = GO(second_csp, &c, "pong");
 
 		msg_t m = {
 			.sender_pid = thread_getpid(),
@@ -131,7 +131,7 @@ int main(void)
 		}
 		channel_close(&c);
 
-		while (csp_running(&second_csp_ctx)) { thread_yield(); }
+		csp_join(second, nullptr);
 	}
 	csp_time[1] = ztimer_now(ZTIMER_USEC);
 
@@ -60,7 +60,7 @@ int main(void)
 	kernel_pid_t my_pid = thread_getpid();
     printf("1st thread started, pid: %" PRIkernel_pid " and arg ", my_pid);
 
-	channel c = channel_make(&c);
+	channel c = channel_make(&c, 0);
 	printf("%p\n", (void*)&c);
     kernel_pid_t pid = thread_create(second_thread_stack, sizeof (second_thread_stack),
                             THREAD_PRIORITY_MAIN - 1, THREAD_CREATE_STACKTEST,
@@ -88,8 +88,15 @@ static void *work_csp(void *args)
 MAYBE_UNUSED
 static ztimer_now_t wrapper_csp(void)
 {
+#if CSP_WATERMARKS
+	// Bigger buffer, and the worker is only woken once it is half full instead of per message.
+	CHANNEL_STATIC(c, CSP_WATERMARKS);
+	channel_make_static(c, true);
+	channel_set_watermarks(&c, CSP_WATERMARKS / 2, 0, 0);
+#else
 	static channel c = {0};
 	c = channel_make(&c, 1);
+#endif
 	msg_t m = {0};
 	m.sender_pid = thread_getpid(); // Manually set sender_pid, msg_send does it for you.
 
@@ -101,6 +108,9 @@ static ztimer_now_t wrapper_csp(void)
 		channel_send(&c, &m, sizeof (m));
 		DEBUG("Thread %"PRIkernel_pid " sent msg %u from %" PRIkernel_pid "\n", thread_getpid(), m.content.value, m.sender_pid);
 	}
+#if CSP_WATERMARKS
+	channel_flush(&c);
+#endif
 	volatile ztimer_now_t after = ztimer_now(ZTIMER_USEC);
 
 	DEBUG("Thread %" PRIkernel_pid " is finished.\n", thread_getpid());
@@ -21,11 +21,15 @@
  */
 
 #include "csp.h"
+#include "csp_trace.h"
 //#define ENABLE_DEBUG 0
 #include "debug.h"
 #include "irq.h"
+#include "kernel_defines.h"
 
 #include <errno.h>
+#include <stdint.h>
+#include <string.h>
 
 /* Implementation of the module */
 
@@ -58,10 +62,41 @@ static inline bool channel_is_creator(const channel c[static const restrict 1])
 { return (c->creator == thread_getpid()); }
 static inline bool channel_is_buffered(const channel c[static const restrict 1])
 { return (c->flags & CHANNEL_BUFFERED); }
+// The files we send to and receive from. MPMC channels use the creator's send file both ways.
+static inline bool channel_send_side(const channel c[static const restrict 1])
+{ return (c->flags & CHANNEL_MPMC) || channel_is_creator(c); }
+static inline bool channel_recv_side(const channel c[static const restrict 1])
+{ return (c->flags & CHANNEL_MPMC) || !channel_is_creator(c); }
+// Checks the file we receive from, see channel_get_rb.
 static inline bool channel_is_empty(const channel c[static const restrict 1])
-{ return rb_empty(&c->files[channel_is_creator(c)].rb); }
+{ return rb_empty(&c->files[channel_recv_side(c)].rb); }
 
 bool channel_is_closed(channel c[static const restrict 1]);
+bool channel_is_send_closed(const channel c[static const restrict 1]);
+static inline bool channel_is_draining(const channel c[static const restrict 1])
+{ return (c->flags & CHANNEL_DRAINING); }
+
+/* Statistics, see channel_get_stats. Compiled out without CSP_STATS. */
+
+#ifdef CSP_STATS
+#define CHANNEL_STAT(c, counter) (++(c)->stats.counter)
+
+// A message of data_size bytes went into f, queued or straight to a receiver.
+static void channel_stats_sent(channel c[static const restrict 1], struct channel_file f[static const restrict 1], const size_t data_size)
+{
+	const size_t i = (size_t)(f - c->files);
+	++c->stats.msgs[i];
+	c->stats.bytes[i] += (uint32_t)data_size;
+	const rb_sizetype used = rb_used(&f->rb);
+	if (used > c->stats.high_water[i]) { c->stats.high_water[i] = used; }
+}
+#else
+#define CHANNEL_STAT(c, counter) ((void)0)
+#define channel_stats_sent(c, f, data_size) ((void)0)
+#endif
+
+// Bytes of a data_size byte message got received, the rest dropped.
+#define channel_stats_received(c, bytes, data_size) ((bytes) != (data_size) ? (void)CHANNEL_STAT(c, partial) : (void)0)
 
 MAYBE_UNUSED static void channel_dump_buffer(const channel c[static const restrict 1]) {
 	static const char *channel_type_str[] = {
@@ -96,9 +131,9 @@ MAYBE_UNUSED static void channel_dump_rb(rb_t *rb) {
 }
 
 // Schedules oneself to sleep
-static unsigned channel_sched_self(thread_t * me[static const restrict 1], const unsigned irq_state) {
-	*me = thread_get_active();
-	sched_set_status(*me, STATUS_SLEEPING);
+static unsigned channel_sched_sleep(const unsigned irq_state) {
+	csp_trace(CSP_TRACE_SCHED_SELF, nullptr, 0);
+	sched_set_status(thread_get_active(), STATUS_SLEEPING);
 	irq_restore(irq_state);
 	DEBUG("%s:%zu: Thread %d control yield.\n", __func__, __LINE__, thread_getpid());
 	thread_yield_higher();
@@ -106,6 +141,18 @@ static unsigned channel_sched_self(thread_t * me[static const restrict 1], const
 	return irq_disable();
 }
 
+static void csp_count_waits(const int n);
+
+// Schedules oneself to sleep, registered in me for the other side to wake.
+// The other side clears me when it wakes us, until then the wait counts for csp_kill.
+static unsigned channel_sched_self(thread_t * me[static const restrict 1], unsigned irq_state) {
+	*me = thread_get_active();
+	csp_count_waits(1);
+	irq_state = channel_sched_sleep(irq_state);
+	csp_count_waits(-1);
+	return irq_state;
+}
+
 static inline void channel_sched_self_thread(thread_t * me[static const restrict 1])
 {
 	if (!me) { return; }
@@ -115,17 +162,16 @@ static inline void channel_sched_self_thread(thread_t * me[static const restrict
 }
 
 // Schedules another thread to run.
-static unsigned channel_sched_other(thread_t * other[static const restrict 1], register const unsigned irq_state) {
+static unsigned channel_sched_thread(thread_t *const thread, register const unsigned irq_state) {
 	bool other_priority_set = false;
 	unsigned short other_priority = 0;
 	DEBUG("%s:%zu: checking for thread %d. \n", __func__, __LINE__, thread_getpid());
-	if ((*other) && ((*other)->status != STATUS_STOPPED && (*other)->status != STATUS_ZOMBIE)) {
-		thread_t *const thread = *other;
-		*other = nullptr;
+	if (thread && (thread->status != STATUS_STOPPED && thread->status != STATUS_ZOMBIE)) {
 		DEBUG("%s: Thread [%p] scheduled.\n", __func__, PTR_CAST(thread));
 		other_priority = thread->priority;
 		other_priority_set = true;
 		sched_set_status(thread, STATUS_PENDING);
+		csp_trace(CSP_TRACE_SCHED_OTHER, thread, (uint32_t)thread_getpid_of(thread));
 	}
 	DEBUG("%s:%zu: Thread %d control yield.\n", __func__, __LINE__, thread_getpid());
 	irq_restore(irq_state);
@@ -134,6 +180,13 @@ static unsigned channel_sched_other(thread_t * other[static const restrict 1], r
 	return irq_disable();
 }
 
+// Schedules the thread registered in other to run.
+static unsigned channel_sched_other(thread_t * other[static const restrict 1], register const unsigned irq_state) {
+	thread_t *const thread = *other;
+	*other = nullptr;
+	return channel_sched_thread(thread, irq_state);
+}
+
 static inline void channel_sched_other_thread(thread_t *other[static const restrict 1])
 { if (other && *other) { thread_wakeup(thread_getpid_of(*other)); } }
 
@@ -169,8 +222,11 @@ static unsigned channel_synchronize(channel c[static const restrict 1], const bo
 		/* Thread Pointer Solution */
 		thread_t **other = sender ? &c->thread_write_blocked : &c->thread_read_blocked;
 		if (*other) {
+			CHANNEL_STAT(c, switches);
 			return channel_sched_other(other, state);
 		}
+		if (sender) { CHANNEL_STAT(c, send_blocked); }
+		else { CHANNEL_STAT(c, recv_blocked); }
 		return channel_sched_self(sender ? &c->thread_read_blocked : &c->thread_write_blocked, state);
 
 		// (creator) ? channel_sched_other(other, state) : channel_sched_self(me, state);
@@ -182,151 +238,612 @@ static unsigned channel_synchronize(channel c[static const restrict 1], const bo
 
 static inline rb_t * channel_get_rb(channel c[static const restrict 1], const bool creator)
 { return &c->files[creator].rb; }
+static inline struct channel_file *channel_get_file(channel c[static const restrict 1], const bool creator)
+{ return &c->files[creator]; }
+static inline struct channel_file *channel_file_of(rb_t rb[static const 1])
+{ return container_of(rb, struct channel_file, rb); }
+static inline bool channel_is_coalesced(const channel c[static const restrict 1])
+{ return (c->flags & CHANNEL_COALESCED); }
+
+/* Wait queues: Highest priority first, first come first served within a priority. */
 
-static rb_sizetype _channel_send_msg(channel c[static const 1], const channel_msg m, unsigned state)
+static void csp_wake_later(thread_t *const thread);
+
+static void channel_queue_add(list_node_t q[static const restrict 1], channel_waiter w[static const restrict 1])
 {
-	rb_t *const rb = channel_get_rb(c, channel_is_creator(c));
-	DEBUG("ch [%p] <- %zu data size %zu bytes. (Bufspace: %zu)\n", ((const void*){0} = c), sizeof (m.data_size), m.data_size, rb_avail(rb));
+	list_node_t *pos = q;
+	while (pos->next && container_of(pos->next, channel_waiter, node)->thread->priority <= w->thread->priority) {
+		pos = pos->next;
+	}
+	list_add(pos, &w->node);
+}
 
-	/* Potential Synchronization point: Sending data size, synchronize if buffer full. */
-	register rb_sizetype data_size_sent_count = rb_add(rb, ((const void*){0} = &m.data_size), sizeof (m.data_size));
-	while (data_size_sent_count != sizeof (m.data_size)) {
-		if (channel_is_closed(c)) {
-			DEBUG("%s:%zu: Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", __func__, __LINE__, thread_getpid(), c->flags);
-			irq_restore(state);
-			return 0;
+// The first waiter in q, dropping select cases left behind after another case of their select went ahead.
+static channel_waiter *channel_queue_first(list_node_t q[static const restrict 1])
+{
+	while (q->next) {
+		channel_waiter *const w = container_of(q->next, channel_waiter, node);
+		if (!(w->select_done && *w->select_done)) { return w; }
+		list_remove_head(q);
+	}
+	return nullptr;
+}
+
+// Whether the waiting receiver w takes a data_size byte message straight, see channel_recv_batch.
+static inline bool channel_waiter_takes(const channel_waiter w[static const restrict 1], const size_t data_size)
+{ return !w->data_size || data_size <= w->data_size; }
+
+// Takes the first waiter off q of c and wakes it to have another look at the channel.
+static unsigned channel_wake_first(channel c[static const restrict 1], list_node_t q[static const restrict 1], const unsigned state)
+{
+	(void)c;
+	channel_waiter *const w = channel_queue_first(q);
+	if (!w) { return state; }
+	list_remove_head(q);
+	w->woken = true;
+	CHANNEL_STAT(c, switches);
+	return channel_sched_thread(w->thread, state);
+}
+
+// Waits in q until the other side or a timeout wakes us, and leaves q either way.
+static unsigned channel_park(list_node_t q[static const restrict 1], channel_waiter w[static const restrict 1], unsigned state)
+{
+	channel_queue_add(q, w);
+	csp_count_waits(1);
+	state = channel_sched_sleep(state);
+	list_remove(q, &w->node);
+	csp_count_waits(-1);
+	return state;
+}
+
+// Wakes a receiver waiting on f, once enough is queued on a coalesced channel.
+static unsigned channel_wake_recv(channel c[static const restrict 1], struct channel_file f[static const restrict 1], const unsigned state)
+{
+	if (channel_is_coalesced(c)
+		&& !(c->high_watermark && rb_used(&f->rb) >= c->high_watermark)
+		&& !(c->wake_msgs && f->queued >= c->wake_msgs)) {
+		return state;
+	}
+	return channel_wake_first(c, &f->receivers, state);
+}
+
+// Wakes a sender waiting for room in f, once it drained far enough on a coalesced channel.
+static unsigned channel_wake_send(channel c[static const restrict 1], struct channel_file f[static const restrict 1], const unsigned state)
+{
+	if (channel_is_coalesced(c) && rb_used(&f->rb) > c->low_watermark) { return state; }
+	return channel_wake_first(c, &f->senders, state);
+}
+
+// After a sender woken from f->senders queued its message: Wakes the next one if its message fits what is left.
+static unsigned channel_wake_next_send(channel c[static const restrict 1], struct channel_file f[static const restrict 1], const unsigned state)
+{
+	const channel_waiter *const w = channel_queue_first(&f->senders);
+	const size_t header_size = (c->elem_size) ? 0 : sizeof (size_t);
+	if (!w || (size_t)rb_avail(&f->rb) < header_size + w->data_size) { return state; }
+	return channel_wake_first(c, &f->senders, state);
+}
+
+// After taking messages out of f: Room for a sender, and what is left for the next receiver.
+static unsigned channel_recv_done(channel c[static const restrict 1], struct channel_file f[static const restrict 1], unsigned state)
+{
+	state = channel_wake_send(c, f, state);
+	if (!rb_empty(&f->rb)) { state = channel_wake_recv(c, f, state); }
+	return state;
+}
+
+// Wakes every thread waiting in q. Counted up front, as a woken thread may come back and wait again.
+static unsigned channel_wake_all(channel c[static const restrict 1], list_node_t q[static const restrict 1], unsigned state)
+{
+	size_t count = 0;
+	for (const list_node_t *n = q->next; n; n = n->next) { ++count; }
+	while (count-- && q->next) { state = channel_wake_first(c, q, state); }
+	return state;
+}
+
+// Nothing queued or waiting to be sent in either direction.
+// Counts blocked senders woken for room that have yet to run, on top of those still queued.
+static bool channel_is_drained(channel c[static const restrict 1])
+{
+	if (c->senders_parked) { return false; }
+	for (size_t i = 0; i != 2; ++i) {
+		if (!rb_empty(&c->files[i].rb) || channel_queue_first(&c->files[i].senders)) { return false; }
+	}
+	return true;
+}
+
+/* Synchronization point: Closed, wake everyone waiting on the channel to see it.
+ * Senders give up, receivers take what is still queued and then give up, barriers and selects return. */
+static unsigned channel_close_all(channel c[static const restrict 1], unsigned state)
+{
+	csp_trace(CSP_TRACE_CLOSE, c, 0);
+	c->flags = (c->flags | CHANNEL_CLOSED) & ~CHANNEL_DRAINING;
+	if (c->thread_read_blocked) { CHANNEL_STAT(c, switches); }
+	if (c->thread_write_blocked) { CHANNEL_STAT(c, switches); }
+	state = channel_sched_other(&c->thread_read_blocked, state);
+	state = channel_sched_other(&c->thread_write_blocked, state);
+	for (size_t i = 0; i != 2; ++i) {
+		state = channel_wake_all(c, &c->files[i].senders, state);
+		state = channel_wake_all(c, &c->files[i].receivers, state);
+	}
+	return state;
+}
+
+#ifdef TSRB
+/* Lock-free SPSC: The sender only moves the write counter of the ring and the receiver only the read counter,
+ * so a message that fits, or is there, goes through without the interrupts disabled.
+ * Waiting stays on the locked path: A thread looks at the ring and sleeps with the interrupts disabled,
+ * so whoever changes the ring after that finds it in the queue. */
+static inline bool channel_is_lock_free(const channel c[static const restrict 1])
+{
+	return (c->flags & (CHANNEL_SPSC | CHANNEL_BUFFERED | CHANNEL_MPMC | CHANNEL_COALESCED | CHANNEL_DRAINING))
+		== (CHANNEL_SPSC | CHANNEL_BUFFERED);
+}
+
+// Wakes the first thread waiting in q, if any, after the ring was changed.
+static void channel_spsc_wake(channel c[static const restrict 1], list_node_t q[static const restrict 1])
+{
+	// Orders the ring change before looking at the queue, against a waiter that queued before it looked at the ring.
+	atomic_thread_fence(memory_order_seq_cst);
+	if (!q->next) { return; }
+	unsigned state = irq_disable();
+	state = channel_wake_first(c, q, state);
+	irq_restore(state);
+}
+#endif
+
+// A flat buffer as a single iolist element. Receive buffers are assumed big enough, so they get no length limit.
+#define CHANNEL_IOL(ptr, size) ((iolist_t){ nullptr, ((void*){0} = (void*)(ptr)), (size) })
+
+// Copies up to data_size bytes between iolists. Null bases in dst discard their bytes.
+static size_t channel_iol_copy(const iolist_t *restrict dst, const iolist_t *restrict src, const size_t data_size)
+{
+	size_t bytes = 0;
+	size_t dst_off = 0;
+	size_t src_off = 0;
+	while (dst && src && bytes != data_size) {
+		size_t chunk = data_size - bytes;
+		if (chunk > dst->iol_len - dst_off) { chunk = dst->iol_len - dst_off; }
+		if (chunk > src->iol_len - src_off) { chunk = src->iol_len - src_off; }
+		if (dst->iol_base) {
+			memcpy(&((unsigned char *){0} = dst->iol_base)[dst_off], &((const unsigned char *){0} = src->iol_base)[src_off], chunk);
 		}
-		rb_drop(rb, data_size_sent_count); // Since we potentially added a broken data size, drop whatever we put.
-		state = channel_sched_self(&c->thread_read_blocked, state); // Synchronize.
-		data_size_sent_count = rb_add(rb, ((const void*){0} = &m.data_size), sizeof (m.data_size)); // Try again.
+		bytes += chunk;
+		dst_off += chunk;
+		src_off += chunk;
+		if (dst_off == dst->iol_len) { dst = dst->iol_next; dst_off = 0; }
+		if (src_off == src->iol_len) { src = src->iol_next; src_off = 0; }
+	}
+	return bytes;
+}
+
+// Queues data_size bytes gathered from the iolist. The caller makes sure they fit.
+static void channel_rb_add_iol(rb_t rb[static const restrict 1], const iolist_t *iol, size_t data_size)
+{
+	for (; iol && data_size; iol = iol->iol_next) {
+		const size_t chunk = (iol->iol_len < data_size) ? iol->iol_len : data_size;
+		rb_add(rb, iol->iol_base, (rb_sizetype)chunk);
+		data_size -= chunk;
+	}
+}
+
+// Scatters a data_size byte message from the buffer into the iolist and drops whatever does not fit.
+static size_t channel_rb_get_iol(rb_t rb[static const restrict 1], const iolist_t *iol, const size_t data_size)
+{
+	size_t bytes = 0;
+	for (; iol && bytes != data_size; iol = iol->iol_next) {
+		const size_t chunk = (iol->iol_len < data_size - bytes) ? iol->iol_len : data_size - bytes;
+		bytes += (iol->iol_base)
+			? (size_t)rb_get(rb, iol->iol_base, (rb_sizetype)chunk)
+			: (size_t)rb_drop(rb, (rb_sizetype)chunk);
 	}
+	rb_drop(rb, (rb_sizetype)(data_size - bytes));
+	return bytes;
+}
+
+// Hands a message to the waiter at the front of q, on the other end of f, and takes it off q.
+// The caller wakes the waiter's thread.
+static size_t channel_rendezvous(
+	channel c[static const restrict 1],
+	struct channel_file f[static const restrict 1],
+	list_node_t q[static const restrict 1],
+	channel_waiter waiter[static const restrict 1],
+	const iolist_t *const dst,
+	const iolist_t *const src,
+	const size_t data_size
+)
+{
+	(void)c;
+	(void)f;
+	list_remove(q, &waiter->node);
+	const size_t bytes = channel_iol_copy(dst, src, data_size);
+	waiter->data_size = bytes;
+	waiter->done = true;
+	if (waiter->select_done) { *waiter->select_done = true; }
+	channel_stats_sent(c, f, data_size);
+	channel_stats_received(c, bytes, data_size);
+	CHANNEL_STAT(c, switches);
+	return bytes;
+}
+
+// Gives up before waiting once *expired is set, if expired is given.
+static size_t _channel_send_iol(
+	channel c[static const 1],
+	const iolist_t *const data,
+	const size_t data_size,
+	const volatile bool *const expired,
+	unsigned state
+)
+{
+	struct channel_file *const f = channel_get_file(c, channel_send_side(c));
+	rb_t *const rb = &f->rb;
+	// Fixed size channels carry no data size, every message is exactly one element.
+	if (c->elem_size && data_size != c->elem_size) { irq_restore(state); return 0; }
+	const size_t header_size = (c->elem_size) ? 0 : sizeof (data_size);
+	// Draining refuses new messages, but lets those already waiting go through.
+	bool parked = false;
 
-	/* Begin channel exchange */
-	rb_sizetype bytes = 0;
 	while (true) {
 		/* Be senstive to potential IRQ changes to channel between synchronizations. */
-		if (channel_is_closed(c)) {
+		if ((parked) ? channel_is_closed(c) : channel_is_send_closed(c)) {
 			DEBUG("%s:%zu: Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", __func__, __LINE__, thread_getpid(), c->flags);
 			irq_restore(state);
-			return bytes; // Return the current bytecount, if any.
-		}
-		if (rb_avail(rb) != 0) {
-			rb_sizetype chunk = 0; // Current sent chumk
-			// First get the chunk, then add chunk to bytes. Allows to see total sent and segmented sent during debug. Chunk is transient.
-			bytes += (chunk = rb_add(rb, &((const rb_buftype *){0} = m.data)[bytes], (m.data_size - bytes)));
-			DEBUG("ch [%p] <- %zu sent %zu/%zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), chunk, bytes, m.data_size, rb_avail(rb));
-			if (chunk) {
-				/* Synchronization point: Data chunk sent. */
-				// After sendt data, schedule the next thread. Restores state.
-				state = channel_sched_other(&c->thread_write_blocked, state);
-				if (bytes == m.data_size) { irq_restore(state); return bytes; } // Total data has been sent.
-				continue;
-			}
+			return 0;
+		}
+		// Behind the senders already waiting, in order: Only the one woken off the queue goes ahead of the rest.
+		const bool in_turn = parked || !channel_queue_first(&f->senders);
+		const bool fits = in_turn && channel_is_buffered(c) && (size_t)rb_avail(rb) >= header_size + data_size;
+		/* Rendezvous: A receiver waits at the start of a message with nothing queued, copy straight into its buffer.
+		 * Coalesced channels rather queue the message and leave the receiver asleep. */
+		channel_waiter *const receiver = channel_queue_first(&f->receivers);
+		const bool takes = receiver && channel_waiter_takes(receiver, data_size);
+		if (takes && rb_empty(rb) && !(fits && channel_is_coalesced(c))) {
+			DEBUG("ch [%p] <- %zu direct to thread %" PRIkernel_pid ".\n", PTR_CAST(c), data_size, thread_getpid_of(receiver->thread));
+			channel_rendezvous(c, f, &f->receivers, receiver, receiver->data, data, data_size);
+			state = channel_sched_thread(receiver->thread, state);
+			irq_restore(state);
+			return data_size;
+		}
+		/* The whole message fits the buffer, queue it in one go so the receiver never sees a partial message. */
+		if (fits) {
+			rb_add(rb, ((const void*){0} = &data_size), (rb_sizetype)header_size);
+			channel_rb_add_iol(rb, data, data_size);
+			++f->queued;
+			channel_stats_sent(c, f, data_size);
+			DEBUG("ch [%p] <- %zu sent %zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), header_size, data_size, rb_avail(rb));
+			/* Synchronization point: Data sent. */
+			state = channel_wake_recv(c, f, state);
+			if (parked) { state = channel_wake_next_send(c, f, state); }
+			irq_restore(state);
+			return data_size;
 		}
-		// An error has occurred or we're in another IRQ.
+		// We cannot wait within an IRQ.
 		if (irq_is_in()) {
 			irq_restore(state);
 			return 0;
 		}
-		/* Synchronization point: Sent data chunk, still not finished. Need other thread to read, so relinquish control. */
-		state = channel_sched_self(&c->thread_read_blocked, state); // I am waiting for reads.
+		// A receiver left asleep by coalescing has to make room first.
+		if (receiver && !rb_empty(rb)) {
+			state = channel_wake_first(c, &f->receivers, state);
+			continue;
+		}
+		// Out of time, nothing of the message was sent.
+		if (expired && *expired) {
+			irq_restore(state);
+			return 0;
+		}
+		/* Synchronization point: Unbuffered, or no room for the message.
+		 * Wait with the message for the receiver to copy it out, or for room in the buffer. */
+		channel_waiter me = { { nullptr }, thread_get_active(), data, data_size, false, nullptr, false };
+		// A batch receiver waiting for smaller messages gets to see this one waiting and leaves it to channel_recv.
+		if (receiver && !takes) {
+			list_remove_head(&f->receivers);
+			csp_wake_later(receiver->thread);
+		}
+		++c->senders_parked;
+		CHANNEL_STAT(c, send_blocked);
+		state = channel_park(&f->senders, &me, state); // I am waiting for reads.
+		--c->senders_parked;
+		parked = true;
+		if (me.done) {
+			irq_restore(state);
+			return data_size;
+		}
 	}
 	UNREACHABLE();
 }
 
+static inline size_t _channel_send_msg(channel c[static const 1], const channel_msg m, const unsigned state)
+{ return _channel_send_iol(c, &CHANNEL_IOL(m.data, m.data_size), m.data_size, nullptr, state); }
+
+#ifdef TSRB
+// Queues the whole message without a lock, or returns 0 for the locked path to deal with it.
+static size_t channel_spsc_send(channel c[static const restrict 1], const void *const restrict data, const size_t data_size)
+{
+	if (!channel_is_lock_free(c) || (c->elem_size && data_size != c->elem_size)) { return 0; }
+	struct channel_file *const f = channel_get_file(c, channel_send_side(c));
+	rb_t *const rb = &f->rb;
+	const size_t header_size = (c->elem_size) ? 0 : sizeof (data_size);
+	if ((size_t)rb_avail(rb) < header_size + data_size) { return 0; }
+	// A receiver waiting on the empty ring rather gets the message copied straight across.
+	if (f->receivers.next && rb_empty(rb)) { return 0; }
+	// Published in one go, so the receiver never sees a partial message.
+	csp_ring_put(rb, 0, &data_size, (rb_sizetype)header_size);
+	csp_ring_put(rb, (rb_sizetype)header_size, data, (rb_sizetype)data_size);
+	csp_ring_publish(rb, (rb_sizetype)(header_size + data_size));
+	++f->queued;
+	channel_stats_sent(c, f, data_size);
+	DEBUG("ch [%p] <- %zu sent %zu bytes lock-free. (Bufspace: %zu)\n", PTR_CAST(c), header_size, data_size, (size_t)rb_avail(rb));
+	/* Synchronization point: Data sent. */
+	channel_spsc_wake(c, &f->receivers);
+	return data_size;
+}
+#endif
+
 // ch <- var
 size_t channel_send(channel c[static const restrict 1], const void *const restrict data, const size_t data_size)
 {
-	if (channel_is_closed(c)) {
+	if (channel_is_send_closed(c)) {
 		DEBUG("%s:%zu: Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", __func__, __LINE__, thread_getpid(), c->flags);
 		return 0;
 	}
+	csp_trace(CSP_TRACE_SEND_START, c, (uint32_t)data_size);
+#ifdef TSRB
+	if (data && data_size) {
+		const size_t bytes = channel_spsc_send(c, data, data_size);
+		if (bytes) { return csp_trace_end(CSP_TRACE_SEND_END, c, bytes); }
+	}
+#endif
 	unsigned state = irq_disable();
 
-	// Synchronization point: Wait for other process to be available.
-	state = channel_synchronize(c, true, state);
-
 	// Calling channel_send with no data size or no data will allow for 1 synchronization point.
 	// This means that channel_send(c, nullptr, 0) == csp_synchronize or csp_barrier.
 	if (!data || !data_size) {
+		// Synchronization point: Wait for other process to be available.
+		state = channel_synchronize(c, true, state);
 		irq_restore(state);
-		return 0;
+		return csp_trace_end(CSP_TRACE_SEND_END, c, 0);
 	}
 
-	// Actually send.
+	// Actually send. Unbuffered channels synchronize on the rendezvous with the receiver.
 	channel_msg m = {data_size, data};
-	return _channel_send_msg(c, m, state);
+	return csp_trace_end(CSP_TRACE_SEND_END, c, _channel_send_msg(c, m, state));
+}
+
+size_t channel_sendv(channel c[static const restrict 1], const iolist_t *const iolist)
+{
+	const size_t data_size = iolist_size(iolist);
+	if (!data_size) { return 0; }
+	if (channel_is_send_closed(c)) {
+		DEBUG("%s:%zu: Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", __func__, __LINE__, thread_getpid(), c->flags);
+		return 0;
+	}
+	csp_trace(CSP_TRACE_SEND_START, c, (uint32_t)data_size);
+	return csp_trace_end(CSP_TRACE_SEND_END, c, _channel_send_iol(c, iolist, data_size, nullptr, irq_disable()));
 }
 
 size_t channel_try_send(channel c[static const restrict 1], const void *restrict data, const size_t data_size)
 {
 	if (!data_size || !data) { return 0; }
-	if (channel_is_closed(c)) {
+	if (channel_is_send_closed(c)) {
 		DEBUG("%s:%zu: Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", __func__, __LINE__, thread_getpid(), c->flags);
 		return 0;
 	}
+	if (c->elem_size && data_size != c->elem_size) { return 0; }
+#ifdef TSRB
+	const size_t sent = channel_spsc_send(c, data, data_size);
+	if (sent) { return sent; }
+#endif
+	const size_t header_size = (c->elem_size) ? 0 : sizeof (data_size);
 	unsigned state = irq_disable();
-	rb_t *const rb = channel_get_rb(c, channel_is_creator(c));
-	DEBUG("ch [%p] <- %zu data size %zu bytes. (Bufspace: %zu)\n", ((const void*){0} = c), sizeof (data_size), data_size, rb_avail(rb));
-	size_t bytes = 0;
-	if ((rb_avail(rb) < data_size) || (bytes = rb_add(rb, ((const void*){0} = &data_size), sizeof (data_size)) != sizeof (data_size))) {
-		rb_drop(rb, bytes);
+	struct channel_file *const f = channel_get_file(c, channel_send_side(c));
+	rb_t *const rb = &f->rb;
+	const bool fits = channel_is_buffered(c) && (size_t)rb_avail(rb) >= header_size + data_size;
+	channel_waiter *const receiver = channel_queue_first(&f->receivers);
+	if (receiver && channel_waiter_takes(receiver, data_size) && rb_empty(rb) && !(fits && channel_is_coalesced(c))) {
+		channel_rendezvous(c, f, &f->receivers, receiver, receiver->data, &CHANNEL_IOL(data, data_size), data_size);
+		state = channel_sched_thread(receiver->thread, state);
+		irq_restore(state);
+		return data_size;
+	}
+	DEBUG("ch [%p] <- %zu data size %zu bytes. (Bufspace: %zu)\n", ((const void*){0} = c), header_size, data_size, rb_avail(rb));
+	// Unbuffered channels only send to a waiting receiver.
+	if (!fits) {
 		irq_restore(state);
 		return 0;
 	}
-	bytes = rb_add(rb, data, data_size);
+	rb_add(rb, ((const void*){0} = &data_size), (rb_sizetype)header_size);
+	const size_t bytes = rb_add(rb, data, (rb_sizetype)data_size);
+	++f->queued;
+	channel_stats_sent(c, f, data_size);
+	state = channel_wake_recv(c, f, state);
 	irq_restore(state);
 	return bytes;
 }
 
 size_t channel_send_msg(channel c[static const restrict 1], const channel_msg m)
-{ return _channel_send_msg(c, m, irq_disable()); }
+{
+	csp_trace(CSP_TRACE_SEND_START, c, (uint32_t)m.data_size);
+	return csp_trace_end(CSP_TRACE_SEND_END, c, _channel_send_msg(c, m, irq_disable()));
+}
 
-// var <- ch
-static size_t _channel_recv_msg(channel c[static const restrict 1], void *const restrict out, register unsigned state)
+size_t channel_send_batch(
+	channel c[static const restrict 1],
+	const size_t count,
+	const void *const restrict data,
+	const size_t data_size
+)
 {
-	size_t data_size = 0;
-	rb_t *const rb = channel_get_rb(c, !channel_is_creator(c));
-	/* Potential synchronization point: If there is no data available, we need to wait for new data. */
-	while (rb_peek(rb, PTR_CAST(&data_size), sizeof (data_size)) != sizeof (data_size)) {
-		state = channel_sched_self(&c->thread_write_blocked, state);
-	} // Data has become available and is extracted. Remove from buffer.
-	if (rb_drop(rb, sizeof (data_size)) != sizeof (data_size)) { return 0; }
-	DEBUG("ch [%p] -> %zu data size %zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), sizeof (data_size), data_size, rb_avail(rb));
+	if (!count || !data || !data_size) { return 0; }
+	if (channel_is_send_closed(c)) {
+		DEBUG("%s:%zu: Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", __func__, __LINE__, thread_getpid(), c->flags);
+		return 0;
+	}
+	if (c->elem_size && data_size != c->elem_size) { return 0; }
+	const size_t header_size = (c->elem_size) ? 0 : sizeof (data_size);
+	const rb_buftype *const msgs = data;
+	const iolist_t first = CHANNEL_IOL(msgs, data_size);
+	size_t sent = 0;
+	bool parked = false;
 
-	rb_sizetype bytes = 0;
+	unsigned state = irq_disable();
+	struct channel_file *const f = channel_get_file(c, channel_send_side(c));
+	rb_t *const rb = &f->rb;
 	while (true) {
-		// Consider that there can be data left over which is complete.
-		// If the available space left contains an entire element, extract first.
-		// We want a closed channel *completey* empty OR having an object too big such that we cannot extract it.
-		if (channel_is_closed(c) && (channel_is_empty(c) || (rb_sizetype)data_size > rb_avail(rb))) {
-			DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
+		// Closed, or draining with nothing of ours waiting: What went out so far.
+		if ((parked && !sent) ? channel_is_closed(c) : channel_is_send_closed(c)) {
 			irq_restore(state);
-			return (bytes == data_size) ? bytes : 0;
+			return sent;
 		}
-
-		if (!rb_empty(rb)) {
-			rb_sizetype chunk = 0;
-			bytes += (chunk = rb_get(rb, &((rb_buftype*){0} = out)[bytes], (rb_sizetype)(data_size - bytes)));
-			DEBUG("ch [%p] -> %zu received %zu/%zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), chunk, bytes, data_size, rb_avail(rb));
-
-			if (chunk) {
-				/* Synchronization point: Data read, allow the other side to send more or continue. */
-				state = channel_sched_other(&c->thread_read_blocked, state);
-				if (bytes == data_size) { irq_restore(state); return bytes; }
-				continue;
+		/* Rendezvous: The first message goes straight to a waiting receiver, the rest queue behind it. */
+		// Behind the senders already waiting, like channel_send.
+		const bool in_turn = parked || !channel_queue_first(&f->senders);
+		const bool fits = in_turn && channel_is_buffered(c) && (size_t)rb_avail(rb) >= header_size + data_size;
+		channel_waiter *const receiver = channel_queue_first(&f->receivers);
+		const bool takes = receiver && channel_waiter_takes(receiver, data_size);
+		const bool direct = !sent && takes && rb_empty(rb) && !(fits && channel_is_coalesced(c));
+		if (direct) {
+			channel_rendezvous(c, f, &f->receivers, receiver, receiver->data, &first, data_size);
+			++sent;
+		}
+		if (in_turn && channel_is_buffered(c)) {
+			for (; sent != count && (size_t)rb_avail(rb) >= header_size + data_size; ++sent) {
+				rb_add(rb, ((const void*){0} = &data_size), (rb_sizetype)header_size);
+				rb_add(rb, &msgs[sent * data_size], (rb_sizetype)data_size);
+				++f->queued;
+				channel_stats_sent(c, f, data_size);
 			}
 		}
+		DEBUG("ch [%p] <- batch sent %zu/%zu messages. (Bufspace: %zu)\n", PTR_CAST(c), sent, count, rb_avail(rb));
+		if (sent) {
+			/* Synchronization point: Wake the receiver once for the whole batch. */
+			state = (direct)
+				? channel_sched_thread(receiver->thread, state)
+				: channel_wake_recv(c, f, state);
+			if (parked) { state = channel_wake_next_send(c, f, state); }
+			irq_restore(state);
+			return sent;
+		}
+		// We cannot wait within an IRQ.
 		if (irq_is_in()) {
 			irq_restore(state);
 			return 0;
 		}
-		/* Synchronization point: Data read, but we're incomplete. Wait for more data. */
-		state = channel_sched_self(&c->thread_write_blocked, state); // I am waiting for writes.
+		// A receiver left asleep by coalescing has to make room first.
+		if (receiver && !rb_empty(rb)) {
+			state = channel_wake_first(c, &f->receivers, state);
+			continue;
+		}
+		/* Synchronization point: Nothing moved, wait with the first message like channel_send. */
+		channel_waiter me = { { nullptr }, thread_get_active(), &first, data_size, false, nullptr, false };
+		// A batch receiver waiting for smaller messages gets to see this one waiting, like in channel_send.
+		if (receiver && !takes) {
+			list_remove_head(&f->receivers);
+			csp_wake_later(receiver->thread);
+		}
+		++c->senders_parked;
+		CHANNEL_STAT(c, send_blocked);
+		state = channel_park(&f->senders, &me, state); // I am waiting for reads.
+		--c->senders_parked;
+		parked = true;
+		if (me.done) { ++sent; }
 	}
 	UNREACHABLE();
 }
 
+// Extracts the size of the message at the front of the buffer into data_size.
+// The caller takes the message out of the buffer after.
+static void channel_recv_header(channel c[static const restrict 1], rb_t rb[static const restrict 1], size_t data_size[static const restrict 1])
+{
+	--channel_file_of(rb)->queued;
+	if (c->elem_size) {
+		// Fixed size channels carry no data size.
+		*data_size = c->elem_size;
+		return;
+	}
+	if (rb_get(rb, PTR_CAST(data_size), sizeof (*data_size)) != sizeof (*data_size)) { *data_size = 0; }
+	DEBUG("ch [%p] -> %zu data size %zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), sizeof (*data_size), *data_size, rb_avail(rb));
+}
+
+#ifdef TSRB
+// Takes the message at the front without a lock, or returns 0 for the locked path to deal with it.
+static size_t channel_spsc_recv(channel c[static const restrict 1], void *const restrict buffer)
+{
+	if (!channel_is_lock_free(c)) { return 0; }
+	struct channel_file *const f = channel_get_file(c, channel_recv_side(c));
+	rb_t *const rb = &f->rb;
+	// Senders publish whole messages, so the message is complete once its start is there.
+	if (rb_empty(rb)) { return 0; }
+	size_t data_size = 0;
+	channel_recv_header(c, rb, &data_size);
+	const size_t bytes = rb_get(rb, buffer, (rb_sizetype)data_size);
+	DEBUG("ch [%p] -> received %zu/%zu bytes lock-free. (Bufspace: %zu)\n", PTR_CAST(c), bytes, data_size, (size_t)rb_avail(rb));
+	/* Synchronization point: Data read, allow the other side to send more. */
+	channel_spsc_wake(c, &f->senders);
+	return bytes;
+}
+#endif
+
+// var <- ch
+// Null bases in out drop their part of the message.
+// Gives up before waiting once *expired is set, if expired is given.
+static size_t _channel_recv_iol(
+	channel c[static const restrict 1],
+	const iolist_t *const out,
+	const volatile bool *const expired,
+	register unsigned state
+)
+{
+	struct channel_file *const f = channel_get_file(c, channel_recv_side(c));
+	rb_t *const rb = &f->rb;
+	/* Potential synchronization point: If there is no data available, we need to wait for new data. */
+	while (rb_empty(rb)) {
+		/* Rendezvous: A sender waits with a whole message, copy straight out of its buffer. */
+		channel_waiter *const sender = channel_queue_first(&f->senders);
+		if (sender) {
+			DEBUG("ch [%p] -> %zu direct from thread %" PRIkernel_pid ".\n", PTR_CAST(c), sender->data_size, thread_getpid_of(sender->thread));
+			const size_t bytes = channel_rendezvous(c, f, &f->senders, sender, out, sender->data, sender->data_size);
+			state = channel_sched_thread(sender->thread, state);
+			irq_restore(state);
+			return bytes;
+		}
+		// Closed, within an IRQ or out of time, nothing was received.
+		if (channel_is_closed(c) || irq_is_in() || (expired && *expired)) {
+			DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
+			irq_restore(state);
+			return 0;
+		}
+		// Drained, finish closing.
+		if (channel_is_draining(c) && channel_is_drained(c)) {
+			state = channel_close_all(c, state);
+			irq_restore(state);
+			return 0;
+		}
+		/* Synchronization point: Wait for a sender to either copy straight into out or queue a message. */
+		channel_waiter me = { { nullptr }, thread_get_active(), out, 0, false, nullptr, false };
+		CHANNEL_STAT(c, recv_blocked);
+		state = channel_park(&f->receivers, &me, state); // I am waiting for writes.
+		if (me.done) {
+			irq_restore(state);
+			return me.data_size;
+		}
+	}
+
+	// Senders queue whole messages, so the message is complete once its start is there.
+	size_t data_size = 0;
+	channel_recv_header(c, rb, &data_size);
+	const size_t bytes = channel_rb_get_iol(rb, out, data_size);
+	channel_stats_received(c, bytes, data_size);
+	DEBUG("ch [%p] -> received %zu/%zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), bytes, data_size, rb_avail(rb));
+
+	/* Synchronization point: Data read, allow the other side to send more or continue. */
+	state = channel_recv_done(c, f, state);
+	irq_restore(state);
+	return bytes;
+}
+
+static inline size_t _channel_recv_msg(channel c[static const restrict 1], void *const restrict out, const unsigned state)
+{ return _channel_recv_iol(c, &CHANNEL_IOL(out, SIZE_MAX), nullptr, state); }
+
 size_t channel_recv(channel c[static const restrict 1], void *const restrict buffer)
 {
 	// Unlike send, we'll allow taking all items out of the buffer before recognizing the closed condition.
@@ -334,151 +851,753 @@ size_t channel_recv(channel c[static const restrict 1], void *const restrict buf
 		DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
 		return 0;
 	}
+	csp_trace(CSP_TRACE_RECV_START, c, 0);
+#ifdef TSRB
+	if (buffer) {
+		const size_t bytes = channel_spsc_recv(c, buffer);
+		if (bytes) { return csp_trace_end(CSP_TRACE_RECV_END, c, bytes); }
+	}
+#endif
 
 	unsigned state = irq_disable();
-	// Synchronization point: Make sure we're ready to send.
-	// If the user specifically requests unbuffered channels, then we skip this synchronization point.
-	state = channel_synchronize(c, false, state);
+	// Calling channel_recv without a buffer pairs with channel_send(c, nullptr, 0) as a synchronization point.
 	if (!buffer) {
+		// Synchronization point: Make sure we're ready to send.
+		// If the user specifically requests unbuffered channels, then we skip this synchronization point.
+		state = channel_synchronize(c, false, state);
 		irq_restore(state);
+		return csp_trace_end(CSP_TRACE_RECV_END, c, 0);
+	}
+	return csp_trace_end(CSP_TRACE_RECV_END, c, _channel_recv_msg(c, buffer, state));
+}
+
+size_t channel_recvv(channel c[static const restrict 1], const iolist_t *const iolist)
+{
+	if (!iolist) { return 0; }
+	if (channel_is_closed(c) && channel_is_empty(c)) {
+		DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
 		return 0;
 	}
-	return _channel_recv_msg(c, buffer, state);
+	csp_trace(CSP_TRACE_RECV_START, c, 0);
+	return csp_trace_end(CSP_TRACE_RECV_END, c, _channel_recv_iol(c, iolist, nullptr, irq_disable()));
 }
 
 // c -> data if any.
 size_t channel_try_recv(channel c[static const restrict 1], void *const buffer)
 {
 	if (!buffer) { return 0; }
-	const bool isnt_creator = !channel_is_creator(c);
 	if (channel_is_closed(c) && channel_is_empty(c)) {
 		DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
 		return 0;
 	}
-	rb_t *const rb = &c->files[isnt_creator].rb;
+#ifdef TSRB
+	const size_t received = channel_spsc_recv(c, buffer);
+	if (received) { return received; }
+#endif
+	struct channel_file *const f = channel_get_file(c, channel_recv_side(c));
+	rb_t *const rb = &f->rb;
 	unsigned state = irq_disable();
-	size_t data_size = rb_get(rb, PTR_CAST(&data_size), sizeof (data_size));
-	if (!data_size) {
+	channel_waiter *const sender = channel_queue_first(&f->senders);
+	if (rb_empty(rb) && sender) {
+		const size_t bytes = channel_rendezvous(c, f, &f->senders, sender, &CHANNEL_IOL(buffer, SIZE_MAX), sender->data, sender->data_size);
+		state = channel_sched_thread(sender->thread, state);
+		irq_restore(state);
+		return bytes;
+	}
+	if (rb_empty(rb)) {
+		// Drained, finish closing.
+		if (channel_is_draining(c) && channel_is_drained(c)) { state = channel_close_all(c, state); }
+		irq_restore(state);
+		return 0;
+	}
+	size_t data_size = c->elem_size;
+	if (!data_size && (rb_get(rb, PTR_CAST(&data_size), sizeof (data_size)) != sizeof (data_size))) {
+		irq_restore(state);
+		return 0;
+	}
+	// Messages are queued whole, a short fixed size element would mean a broken ring: Take nothing rather than half.
+	if (!data_size || (c->elem_size && (size_t)rb_used(rb) < data_size)) {
 		irq_restore(state);
 		return 0;
 	}
 	const size_t bytes = (size_t)rb_get(rb, ((rb_buftype*){0} = buffer), data_size);
+	--f->queued;
 	DEBUG("ch [%p] -> received %zu/%zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), bytes, data_size, rb_avail(rb));
+	// Room was made, let a waiting sender continue.
+	state = channel_recv_done(c, f, state);
 	irq_restore(state);
 	return bytes;
 }
 
-channel_msg channel_recv_msg(channel c[static const restrict 1], void *const restrict out)
-{
-	size_t msg_data_size = _channel_recv_msg(c, out, irq_disable());
-	return (channel_msg){msg_data_size, out};
-}
-
-size_t channel_drop(channel c[static const restrict 1])
+size_t channel_recv_batch(
+	channel c[static const restrict 1],
+	const size_t count,
+	void *const restrict buffer,
+	const size_t data_size
+)
 {
-	// Unlike send, we'll allow taking all items out of the buffer before recognizing the closed condition.
+	if (!count || !buffer || !data_size) { return 0; }
 	if (channel_is_closed(c) && channel_is_empty(c)) {
 		DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
 		return 0;
 	}
+	rb_buftype *const out = buffer;
+	size_t received = 0;
 
 	unsigned state = irq_disable();
-	// Synchronization point: Make sure we're ready to send.
-	// If the user specifically requests unbuffered channels, then we skip this synchronization point.
-	state = channel_synchronize(c, !channel_is_creator(c), state);
-
-	size_t data_size = 0;
-	rb_t *const rb = channel_get_rb(c, !channel_is_creator(c));
-	/* Potential synchronization point: If there is no data available, we need to wait for new data. */
-	while (rb_peek(rb, PTR_CAST(&data_size), sizeof (data_size)) != sizeof (data_size)) {
-		state = channel_sched_self(&c->thread_write_blocked, state);
-	} // Data has become available and is extracted. Remove from buffer.
-	if (rb_drop(rb, sizeof (data_size)) != sizeof (data_size)) { return 0; }
-	DEBUG("ch [%p] -> %zu data size %zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), sizeof (data_size), data_size, rb_avail(rb));
-
-	rb_sizetype bytes = 0;
+	struct channel_file *const f = channel_get_file(c, channel_recv_side(c));
+	rb_t *const rb = &f->rb;
 	while (true) {
-		// Consider that there can be data left over which is complete.
-		// If the available space left contains an entire element, extract first.
-		// We want a closed channel *completey* empty OR having an object too big such that we cannot extract it.
-		if (channel_is_closed(c) && (channel_is_empty(c) || (rb_sizetype)data_size > rb_avail(rb))) {
-			DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
+		// Queued messages first, stopping at one too big for a slot.
+		while (received != count && !rb_empty(rb)) {
+			size_t msg_size = c->elem_size;
+			if (!msg_size) { rb_peek(rb, PTR_CAST(&msg_size), sizeof (msg_size)); }
+			if (msg_size > data_size) { break; }
+			channel_recv_header(c, rb, &msg_size);
+			rb_get(rb, &out[received * data_size], (rb_sizetype)msg_size);
+			++received;
+		}
+		/* Rendezvous: A waiting sender comes after everything queued before it. */
+		channel_waiter *const sender = channel_queue_first(&f->senders);
+		thread_t *direct = nullptr;
+		if (received != count && rb_empty(rb) && sender && sender->data_size <= data_size) {
+			channel_rendezvous(c, f, &f->senders, sender, &CHANNEL_IOL(&out[received * data_size], data_size), sender->data, sender->data_size);
+			direct = sender->thread;
+			++received;
+		}
+		DEBUG("ch [%p] -> batch received %zu/%zu messages. (Bufspace: %zu)\n", PTR_CAST(c), received, count, rb_avail(rb));
+		if (received) {
+			/* Synchronization point: Wake the sender once for the whole batch. */
+			state = channel_recv_done(c, f, state);
+			state = channel_sched_thread(direct, state);
 			irq_restore(state);
-			return (bytes == data_size) ? bytes : 0;
+			return received;
 		}
-
-		// If nullptr is passed to channel_recv, it will effectively drop one message from sender.
-		rb_sizetype chunk = 0;
-		bytes += (chunk = rb_drop(rb, (rb_sizetype)(data_size - bytes)));
-		DEBUG("ch [%p] -> %zu dropped %zu/%zu bytes. (Bufspace: %zu)\n", PTR_CAST(c), chunk, bytes, data_size, rb_avail(rb));
-
-		if (bytes) {
-			/* Synchronization point: Data read, allow the other side to send more or continue. */
-			state = channel_sched_other(&c->thread_read_blocked, state);
-			if (bytes == data_size) { irq_restore(state); return bytes; }
+		// The next message is bigger than a slot, queued or waiting with its sender: Leave it for channel_recv.
+		// Senders only wake receivers for new messages, so waiting would miss it.
+		if (!rb_empty(rb) || sender || channel_is_closed(c) || irq_is_in()) {
+			irq_restore(state);
+			return 0;
 		}
-		if (c->thread_write_blocked || irq_is_in()) {
+		if (channel_is_draining(c) && channel_is_drained(c)) {
+			state = channel_close_all(c, state);
 			irq_restore(state);
 			return 0;
 		}
-		/* Synchronization point: Data read, but we're incomplete. Wait for more data. */
-		state = channel_sched_self(&c->thread_write_blocked, state); // I am waiting for writes.
+		/* Synchronization point: Nothing there, wait for the first message like channel_recv.
+		 * Only messages that fit a slot come straight across, bigger ones wake us to leave them. */
+		channel_waiter me = { { nullptr }, thread_get_active(), &CHANNEL_IOL(out, data_size), data_size, false, nullptr, false };
+		CHANNEL_STAT(c, recv_blocked);
+		state = channel_park(&f->receivers, &me, state); // I am waiting for writes.
+		if (me.done) { ++received; }
 	}
 	UNREACHABLE();
 }
 
-size_t channel_send_select(
-	const size_t channel_count,
-	channel *c[static const restrict channel_count],
-	const void *restrict data,
-	const size_t data_size
-);
-size_t channel_recv_select(
-	const size_t channel_count,
-	channel *c[static const restrict channel_count],
-	void *restrict data
-);
-
-void *channel_recv_ptr(channel c[static const restrict 1], void *const buffer);
-
-// Requires the caller to pass in the parent object so we have access to it's memory location.
-channel channel_make(channel c[static const restrict 1], const bool buffered)
+channel_msg channel_recv_msg(channel c[static const restrict 1], void *const restrict out)
 {
-	*c = (channel){
-		thread_getpid(),
-		0 | (buffered ? CHANNEL_BUFFERED : 0),
-		nullptr,
-		nullptr,
-		{
-			{
-				RB_INIT(c->files[0].buffer),
-				{0},
-			},
-			{
-				RB_INIT(c->files[1].buffer),
-				{0},
-			},
-		},
-	};
-	c->files[0].rb.buf = (c->files[0].buffer); // Reassign the pointers to the parent object
-	c->files[1].rb.buf = (c->files[1].buffer); // Reassign the pointers to the parent object
-	return *c;
+	size_t msg_data_size = _channel_recv_msg(c, out, irq_disable());
+	return (channel_msg){msg_data_size, out};
 }
 
-// Recognize which side we're on and close that file.
-inline void channel_close(channel c[static const restrict 1])
+size_t channel_drop(channel c[static const restrict 1])
 {
-	// DEBUG("%s:%d: Thread %" PRIkernel_pid " closing channel.\n", __func__, __LINE__, thread_getpid());
-	// c->files[channel_is_creator(c)].is_closed = 1;
-	c->flags |= CHANNEL_CLOSED;
+	// Unlike send, we'll allow taking all items out of the buffer before recognizing the closed condition.
+	if (channel_is_closed(c) && channel_is_empty(c)) {
+		DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
+		return 0;
+	}
+	// Receiving into nothing drops one message from the sender.
+	csp_trace(CSP_TRACE_RECV_START, c, 0);
+	return csp_trace_end(CSP_TRACE_RECV_END, c, _channel_recv_msg(c, nullptr, irq_disable()));
+}
+
+/* SELECT */
+
+// Whether q holds a waiter of another thread or select than ours.
+static bool channel_queue_has_other(list_node_t q[static const restrict 1], const bool select_done[static const 1])
+{
+	if (!channel_queue_first(q)) { return false; }
+	for (list_node_t *n = q->next; n; n = n->next) {
+		const channel_waiter *const w = container_of(n, channel_waiter, node);
+		if (w->select_done != select_done && !(w->select_done && *w->select_done)) { return true; }
+	}
+	return false;
+}
+
+// A send of the wrong size for a fixed size channel, which channel_send refuses.
+static inline bool channel_case_is_misfit(const channel_case k[static const restrict 1])
+{ return k->send && k->c->elem_size && k->data_size != k->c->elem_size; }
+
+// Whether the case can go ahead without waiting. Closed channels and misfits are ready, see channel_select.
+static bool channel_case_is_ready(channel_case k[static const restrict 1], const bool select_done[static const 1])
+{
+	channel *const c = k->c;
+	if (channel_case_is_misfit(k)) { return true; }
+	if (k->send) {
+		struct channel_file *const f = channel_get_file(c, channel_send_side(c));
+		const size_t header_size = (c->elem_size) ? 0 : sizeof (k->data_size);
+		return channel_is_send_closed(c)
+			|| (channel_queue_has_other(&f->receivers, select_done) && rb_empty(&f->rb)
+				&& channel_waiter_takes(channel_queue_first(&f->receivers), k->data_size))
+			|| (channel_is_buffered(c) && (size_t)rb_avail(&f->rb) >= header_size + k->data_size);
+	}
+	struct channel_file *const f = channel_get_file(c, channel_recv_side(c));
+	return !rb_empty(&f->rb) || channel_queue_has_other(&f->senders, select_done) || channel_is_closed(c);
+}
+
+// The queue a case waits in, like a waiting channel_send or channel_recv.
+static inline list_node_t *channel_case_queue(channel_case k[static const restrict 1])
+{
+	return (k->send)
+		? &channel_get_file(k->c, channel_send_side(k->c))->senders
+		: &channel_get_file(k->c, channel_recv_side(k->c))->receivers;
+}
+
+static void channel_case_park(channel_case k[static const restrict 1], thread_t *const me, bool select_done[static const 1])
+{
+	k->iolist = CHANNEL_IOL(k->data, (k->send) ? k->data_size : SIZE_MAX);
+	k->waiter = (channel_waiter){ { nullptr }, me, &k->iolist, (k->send) ? k->data_size : 0, false, select_done, false };
+	channel_queue_add(channel_case_queue(k), &k->waiter);
+	if (k->send) { CHANNEL_STAT(k->c, send_blocked); }
+	else { CHANNEL_STAT(k->c, recv_blocked); }
+}
+
+// Hands the wakeup k got without going ahead on to the next waiter in its queue, with interrupts disabled.
+static void channel_case_pass_wakeup(channel_case k[static const restrict 1])
+{
+	list_node_t *const q = channel_case_queue(k);
+	channel_waiter *const w = channel_queue_first(q);
+	if (!w) { return; }
+	list_remove_head(q);
+	w->woken = true;
+	csp_wake_later(w->thread);
+}
+
+// Gives up like a nonblocking select once *expired is set, if expired is given.
+static size_t _channel_select(
+	const size_t case_count,
+	channel_case cases[static const case_count],
+	const bool nonblocking,
+	const volatile bool *const expired
+)
+{
+	// Rotates the case tried first, so a busy case cannot starve the others.
+	static unsigned turn = 0;
+	if (!case_count) { return 0; }
+	thread_t *const me = thread_get_active();
+	// The case a plain wakeup took off its queue, tried first on the way around.
+	size_t woken = case_count;
+
+	while (true) {
+		const size_t start = (woken != case_count) ? woken : turn++ % case_count;
+		for (size_t n = 0; n != case_count; ++n) {
+			const size_t i = (start + n) % case_count;
+			channel_case *const k = &cases[i];
+			if (k->send) {
+				if (channel_is_send_closed(k->c) || channel_case_is_misfit(k)) {
+					k->data_size = 0;
+					return i;
+				}
+				if (channel_try_send(k->c, k->data, k->data_size)) { return i; }
+			}
+			else {
+				if (channel_is_closed(k->c) && channel_is_empty(k->c)) {
+					k->data_size = 0;
+					return i;
+				}
+				if ((k->data_size = channel_try_recv(k->c, k->data))) { return i; }
+			}
+		}
+		// We cannot wait within an IRQ either.
+		if (nonblocking || irq_is_in() || (expired && *expired)) { return case_count; }
+
+		/* Synchronization point: Wait on every case at once, the first other side to come along picks its case. */
+		bool select_done = false;
+		size_t parked = 0;
+		unsigned state = irq_disable();
+		// The timer may have gone off since the check above, and would not wake us again.
+		bool ready = expired && *expired;
+		csp_count_waits(1);
+		for (; parked != case_count && !ready; ++parked) {
+			// Something changed since the try above, go around again without sleeping.
+			ready = channel_case_is_ready(&cases[parked], &select_done);
+			if (ready) { break; }
+			channel_case_park(&cases[parked], me, &select_done);
+		}
+		if (!ready) {
+			DEBUG("%s: Thread %" PRIkernel_pid " waits on %zu cases.\n", __func__, thread_getpid(), case_count);
+			state = channel_sched_sleep(state);
+		}
+		size_t fired = case_count;
+		woken = case_count;
+		bool passed = false;
+		// Only the parked cases have a waiter of this round, the rest may hold one left from an earlier call.
+		for (size_t i = 0; i != parked; ++i) {
+			list_remove(channel_case_queue(&cases[i]), &cases[i].waiter.node);
+			// Cases dropped by channel_queue_first after another one fired got no wakeup, only these did.
+			const bool taken = cases[i].waiter.woken;
+			if (cases[i].waiter.done && cases[i].waiter.select_done == &select_done) { fired = i; }
+			else if (taken && woken == case_count) { woken = i; }
+			// Only one case goes ahead, the next waiter of the others gets their wakeup.
+			else if (taken) {
+				channel_case_pass_wakeup(&cases[i]);
+				passed = true;
+			}
+		}
+		if (fired != case_count && woken != case_count) {
+			channel_case_pass_wakeup(&cases[woken]);
+			passed = true;
+		}
+		csp_count_waits(-1);
+		irq_restore(state);
+		if (passed) { thread_yield_higher(); }
+		if (fired != case_count) {
+			if (!cases[fired].send) { cases[fired].data_size = cases[fired].waiter.data_size; }
+			return fired;
+		}
+	}
+	UNREACHABLE();
+}
+
+size_t channel_select(const size_t case_count, channel_case cases[static const case_count], const bool nonblocking)
+{ return _channel_select(case_count, cases, nonblocking, nullptr); }
+
+size_t channel_send_select(
+	const size_t channel_count,
+	channel *c[static const restrict channel_count],
+	const void *restrict data,
+	const size_t data_size
+)
+{
+	channel_case cases[channel_count];
+	for (size_t i = 0; i != channel_count; ++i) { cases[i] = CHANNEL_CASE_SEND(c[i], data, data_size); }
+	return channel_select(channel_count, cases, false);
+}
+
+size_t channel_recv_select(
+	const size_t channel_count,
+	channel *c[static const restrict channel_count],
+	void *restrict data
+)
+{
+	channel_case cases[channel_count];
+	for (size_t i = 0; i != channel_count; ++i) { cases[i] = CHANNEL_CASE_RECV(c[i], data); }
+	return channel_select(channel_count, cases, false);
+}
+
+void *channel_recv_ptr(channel c[static const restrict 1], void *const buffer);
+
+// Requires the caller to pass in the parent object so we have access to it's memory location.
+channel channel_make_buf(
+	channel c[static const restrict 1],
+	const bool buffered,
+	const size_t send_size,
+	rb_buftype send[static const send_size],
+	const size_t recv_size,
+	rb_buftype recv[static const recv_size]
+)
+{
+	c->creator = thread_getpid();
+	c->flags = 0 | (buffered ? CHANNEL_BUFFERED : 0);
+	c->thread_read_blocked = nullptr;
+	c->thread_write_blocked = nullptr;
+	c->senders_parked = 0;
+#ifdef CSP_STATS
+	c->stats = (channel_stats){ 0 };
+#endif
+	c->elem_size = 0;
+	c->high_watermark = 0;
+	c->wake_msgs = 0;
+	c->low_watermark = 0;
+	for (size_t i = 0; i != 2; ++i) {
+		c->files[i].queued = 0;
+		c->files[i].senders.next = nullptr;
+		c->files[i].receivers.next = nullptr;
+	}
+	// The creator writes to file 1 and reads from file 0, see channel_get_rb.
+	rb_init(&c->files[0].rb, recv, (rb_sizetype)recv_size);
+	rb_init(&c->files[1].rb, send, (rb_sizetype)send_size);
+	if (c->files[0].rb.size != recv_size || c->files[1].rb.size != send_size) {
+		DEBUG("%s:%zu: Storage of %zu and %zu bytes rounded down to %u and %u, see RB_SIZE.\n", __func__, __LINE__,
+			send_size, recv_size, c->files[1].rb.size, c->files[0].rb.size);
+	}
+	return *c;
+}
+
+channel channel_make_fixed(
+	channel c[static const restrict 1],
+	const bool buffered,
+	const size_t elem_size,
+	const size_t send_size,
+	rb_buftype send[static const send_size],
+	const size_t recv_size,
+	rb_buftype recv[static const recv_size]
+)
+{
+	channel_make_buf(c, buffered, send_size, send, recv_size, recv);
+	c->elem_size = (rb_sizetype)elem_size;
+	return *c;
+}
+
+#if CHANNEL_BUFSIZE > 0
+channel channel_make(channel c[static const restrict 1], const bool buffered)
+{
+	return channel_make_buf(
+		c,
+		buffered,
+		sizeof (c->files[1].buffer), c->files[1].buffer,
+		sizeof (c->files[0].buffer), c->files[0].buffer
+	);
+}
+#endif
+
+// Recognize which side we're on and close that file.
+void channel_close(channel c[static const restrict 1])
+{
+	// DEBUG("%s:%d: Thread %" PRIkernel_pid " closing channel.\n", __func__, __LINE__, thread_getpid());
+	// c->files[channel_is_creator(c)].is_closed = 1;
+	unsigned state = irq_disable();
+	state = channel_close_all(c, state);
+	irq_restore(state);
+}
+
+void channel_close_drain(channel c[static const restrict 1])
+{
+	unsigned state = irq_disable();
+	if (channel_is_closed(c)) {
+		irq_restore(state);
+		return;
+	}
+	c->flags |= CHANNEL_DRAINING;
+	if (channel_is_drained(c)) {
+		state = channel_close_all(c, state);
+	}
+	else {
+		// Receivers left asleep by coalescing take the rest now, and whoever finds nothing left closes.
+		for (size_t i = 0; i != 2; ++i) { state = channel_wake_all(c, &c->files[i].receivers, state); }
+	}
+	irq_restore(state);
 }
 //void channel_open(channel c[static const restrict 1]);
 
+void channel_set_watermarks(channel c[static const restrict 1], const size_t high, const size_t msgs, const size_t low)
+{
+	unsigned state = irq_disable();
+	c->high_watermark = (rb_sizetype)high;
+	c->wake_msgs = (rb_sizetype)msgs;
+	c->low_watermark = (rb_sizetype)low;
+	c->flags = (high || msgs) ? (c->flags | CHANNEL_COALESCED) : (c->flags & ~CHANNEL_COALESCED);
+	irq_restore(state);
+}
+
+void channel_flush(channel c[static const restrict 1])
+{
+	// Only buffered channels coalesce, and every wait there rechecks the buffer, so waking both sides is safe.
+	if (!channel_is_buffered(c)) { return; }
+	unsigned state = irq_disable();
+	for (size_t i = 0; i != 2; ++i) {
+		state = channel_wake_first(c, &c->files[i].receivers, state);
+		state = channel_wake_first(c, &c->files[i].senders, state);
+	}
+	irq_restore(state);
+}
+
 void channel_set_unbuffered(channel c[static const restrict 1], const bool buffered);
 void channel_set_owner(channel c[static const restrict 1], const kernel_pid_t thread_id);
+void channel_set_mpmc(channel c[static const restrict 1]);
+void channel_set_spsc(channel c[static const restrict 1]);
+
+/* TIMEOUTS */
+
+#if IS_USED(MODULE_ZTIMER)
+// A timer waking the thread out of a channel wait, which then sees expired and gives up.
+typedef struct channel_deadline channel_deadline;
+struct channel_deadline {
+	ztimer_t timer;
+	thread_t *thread;
+	volatile bool expired;
+};
+
+static void channel_deadline_expire(void *arg)
+{
+	channel_deadline *const d = arg;
+	d->expired = true;
+	// Waits check expired with interrupts disabled before sleeping, so this cannot get lost.
+	thread_wakeup(thread_getpid_of(d->thread));
+}
+
+static void channel_deadline_set(channel_deadline d[static const restrict 1], ztimer_clock_t *const clock, const uint32_t timeout)
+{
+	d->thread = thread_get_active();
+	d->expired = !timeout;
+	d->timer = (ztimer_t){ .callback = channel_deadline_expire, .arg = d };
+	// A timeout of 0 never waits, like the try functions.
+	if (timeout) { ztimer_set(clock, &d->timer, timeout); }
+	csp_count_waits(1);
+}
+
+static void channel_deadline_clear(channel_deadline d[static const restrict 1], ztimer_clock_t *const clock)
+{
+	ztimer_remove(clock, &d->timer);
+	csp_count_waits(-1);
+}
+
+size_t channel_send_timeout(
+	channel c[static const restrict 1],
+	const void *const restrict data,
+	const size_t data_size,
+	ztimer_clock_t *const clock,
+	const uint32_t timeout
+)
+{
+	if (!data || !data_size) { return 0; }
+	if (channel_is_send_closed(c)) {
+		DEBUG("%s:%zu: Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", __func__, __LINE__, thread_getpid(), c->flags);
+		return 0;
+	}
+	channel_deadline d;
+	channel_deadline_set(&d, clock, timeout);
+	csp_trace(CSP_TRACE_SEND_START, c, (uint32_t)data_size);
+	const size_t bytes = _channel_send_iol(c, &CHANNEL_IOL(data, data_size), data_size, &d.expired, irq_disable());
+	channel_deadline_clear(&d, clock);
+	return csp_trace_end(CSP_TRACE_SEND_END, c, bytes);
+}
+
+size_t channel_recv_timeout(
+	channel c[static const restrict 1],
+	void *const restrict buffer,
+	ztimer_clock_t *const clock,
+	const uint32_t timeout
+)
+{
+	if (channel_is_closed(c) && channel_is_empty(c)) {
+		DEBUG("Thread %" PRIkernel_pid ": Channel file is closed with flags %d.\n", thread_getpid(), c->flags);
+		return 0;
+	}
+	channel_deadline d;
+	channel_deadline_set(&d, clock, timeout);
+	// Without a buffer the message is dropped, like channel_drop.
+	csp_trace(CSP_TRACE_RECV_START, c, 0);
+	const size_t bytes = _channel_recv_iol(c, &CHANNEL_IOL(buffer, SIZE_MAX), &d.expired, irq_disable());
+	channel_deadline_clear(&d, clock);
+	return csp_trace_end(CSP_TRACE_RECV_END, c, bytes);
+}
+
+size_t channel_select_timeout(
+	const size_t case_count,
+	channel_case cases[static const case_count],
+	ztimer_clock_t *const clock,
+	const uint32_t timeout
+)
+{
+	channel_deadline d;
+	channel_deadline_set(&d, clock, timeout);
+	const size_t selected = _channel_select(case_count, cases, false, &d.expired);
+	channel_deadline_clear(&d, clock);
+	return selected;
+}
+#endif
+
+/* BLOCK POOL */
+
+void channel_pool_init(
+	channel_pool p[static const restrict 1],
+	void *const restrict storage,
+	const size_t block_size,
+	const size_t block_count
+)
+{
+#if __clang__
+	#pragma clang diagnostic push
+	#pragma clang diagnostic ignored "-Wsign-conversion"
+#endif
+	assert(block_size >= sizeof (void *) && "Block too smol to link");
+#if __clang__
+	#pragma clang diagnostic pop
+#endif
+	*p = (channel_pool) {
+		nullptr,
+		block_size,
+		block_count,
+		{ nullptr },
+	};
+	// Thread the free list through the first word of every block.
+	unsigned char *const blocks = storage;
+	for (size_t i = block_count; i != 0; --i) {
+		void *const block = &blocks[(i - 1) * block_size];
+		*(void **)block = p->free;
+		p->free = block;
+	}
+}
+
+void *channel_pool_try_alloc(channel_pool p[static const restrict 1])
+{
+	const unsigned state = irq_disable();
+	void *const block = p->free;
+	if (block) {
+		p->free = *(void **)block;
+		--p->free_count;
+	}
+	irq_restore(state);
+	return block;
+}
+
+void *channel_pool_alloc(channel_pool p[static const restrict 1])
+{
+	unsigned state = irq_disable();
+	/* Synchronization point: Pool exhausted, wait for a receiver to release a block. */
+	while (!p->free) {
+		if (irq_is_in()) {
+			irq_restore(state);
+			return nullptr;
+		}
+		channel_waiter w = { .thread = thread_get_active() };
+		state = channel_park(&p->waiters, &w, state);
+	}
+	void *const block = p->free;
+	p->free = *(void **)block;
+	--p->free_count;
+	irq_restore(state);
+	return block;
+}
+
+// Puts a block back with interrupts disabled. Takes the first thread waiting for a block off the queue, for the caller to wake.
+static thread_t *channel_pool_push(channel_pool p[static const restrict 1], void *const restrict block)
+{
+	*(void **)block = p->free;
+	p->free = block;
+	++p->free_count;
+	channel_waiter *const waiting = channel_queue_first(&p->waiters);
+	if (!waiting) { return nullptr; }
+	list_remove_head(&p->waiters);
+	return waiting->thread;
+}
+
+void channel_pool_free(channel_pool p[static const restrict 1], void *const restrict block)
+{
+	if (!block) { return; }
+	unsigned state = irq_disable();
+	irq_restore(channel_sched_thread(channel_pool_push(p, block), state));
+}
+
+size_t channel_send_block(channel c[static const restrict 1], void *const block);
+void *channel_recv_block(channel c[static const restrict 1]);
 
 /* CSP */
 
+#if __STDC_VERSION__ > 201710L
+static constexpr short csp_ctx_size = (sizeof (csp_ctx) + alignof (csp_ctx) - 1) & ~(alignof (csp_ctx) - 1);
+#else
+#define csp_ctx_size (sizeof (csp_ctx) + alignof (csp_ctx) - 1) & ~(alignof (csp_ctx) - 1)
+#endif
+
+// Makes a sleeping thread ready without switching to it, with interrupts disabled.
+static void csp_wake_later(thread_t *const thread)
+{
+	if (thread && thread->status == STATUS_SLEEPING) { sched_set_status(thread, STATUS_PENDING); }
+}
+
+// Readies every thread waiting in q, with interrupts disabled.
+static void csp_wake_all_later(list_node_t q[static const 1])
+{
+	for (channel_waiter *w; (w = channel_queue_first(q)); ) {
+		list_remove_head(q);
+		csp_wake_later(w->thread);
+	}
+}
+
+// One done with interrupts disabled, readying the waiters once the count is back to 0.
+static void csp_waitgroup_count_down(csp_waitgroup wg[static const 1])
+{
+#if __clang__
+	#pragma clang diagnostic push
+	#pragma clang diagnostic ignored "-Wsign-conversion"
+#endif
+	assert(wg->count && "csp_waitgroup_done without csp_waitgroup_add");
+#if __clang__
+	#pragma clang diagnostic pop
+#endif
+	if (--wg->count) { return; }
+	csp_wake_all_later(&wg->waiters);
+}
+
+// The process each thread runs, nullptr for other threads.
+static csp_ctx *csp_procs[KERNEL_PID_LAST + 1];
+
+// Counts the wait queues and timers the calling process is in up or down, see csp_kill.
+static void csp_count_waits(const int n)
+{
+	csp_ctx *const ctx = csp_procs[thread_getpid()];
+	if (ctx) { ctx->waits = (unsigned short)(ctx->waits + n); }
+}
+
+// The process stopped: Clears CSP_RUNNING, readies every joiner and counts down its wait group, with interrupts disabled.
+static void csp_exit(csp_ctx ctx[static const 1])
+{
+	ctx->flags &= ~CSP_RUNNING;
+	csp_wake_all_later(&ctx->joiners);
+	if (ctx->wg) { csp_waitgroup_count_down(ctx->wg); }
+}
+
+#ifdef CSP_SLAB
+/* Stack slab: A block pool per size class. Every block starts with the free list link,
+ * so the csp_ctx behind it is left as it was while the block is free. */
+
+#define CSP_SLAB_ALIGN(size) (((size) + alignof (csp_ctx) - 1) & ~(alignof (csp_ctx) - 1))
+#define CSP_SLAB_LINK CSP_SLAB_ALIGN(sizeof (void *))
+#define CSP_SLAB_BLOCK(size) (CSP_SLAB_LINK + CSP_SLAB_ALIGN(size))
+
+_Static_assert(CSP_SLAB_SMALL_COUNT > 0 && CSP_SLAB_LARGE_COUNT > 0, "Every slab class needs a stack");
+_Static_assert(CSP_SLAB_SMALL_SIZE <= CSP_SLAB_LARGE_SIZE, "Slab classes go from small to large");
+
+static _Alignas (csp_ctx) char csp_slab_small[CSP_SLAB_SMALL_COUNT][CSP_SLAB_BLOCK(CSP_SLAB_SMALL_SIZE)];
+static _Alignas (csp_ctx) char csp_slab_large[CSP_SLAB_LARGE_COUNT][CSP_SLAB_BLOCK(CSP_SLAB_LARGE_SIZE)];
+static channel_pool csp_slabs[2];
+static const size_t csp_slab_sizes[2] = { CSP_SLAB_ALIGN(CSP_SLAB_SMALL_SIZE), CSP_SLAB_ALIGN(CSP_SLAB_LARGE_SIZE) };
+
+// Takes a stack of at least size bytes, see CSP_INIT. Returns no stack for sizes beyond the largest class.
+static struct csp_stack csp_slab_take(const size_t size, channel_pool *slab[static const restrict 1])
+{
+	unsigned state = irq_disable();
+	if (!csp_slabs[0].block_size) {
+		channel_pool_init(&csp_slabs[0], csp_slab_small, sizeof (csp_slab_small[0]), CSP_SLAB_SMALL_COUNT);
+		channel_pool_init(&csp_slabs[1], csp_slab_large, sizeof (csp_slab_large[0]), CSP_SLAB_LARGE_COUNT);
+	}
+	irq_restore(state);
+
+	size_t fit = 0;
+	while (fit != ARRAY_SIZE(csp_slabs) && csp_slab_sizes[fit] < size) { ++fit; }
+	if (fit == ARRAY_SIZE(csp_slabs)) { return (struct csp_stack){ nullptr, 0 }; }
+	char *block = nullptr;
+	size_t i = fit;
+	for (; !block && i != ARRAY_SIZE(csp_slabs); ++i) { block = channel_pool_try_alloc(&csp_slabs[i]); }
+	if (block) { --i; }
+	else {
+		// Every class that fits is in use, wait for the smallest, queued behind the spawners already waiting.
+		i = fit;
+		block = channel_pool_alloc(&csp_slabs[i]);
+		if (!block) { return (struct csp_stack){ nullptr, 0 }; }
+	}
+	*slab = &csp_slabs[i];
+	return (struct csp_stack){ block + CSP_SLAB_LINK, csp_slab_sizes[i] };
+}
+
+// Gives the stack of an exited process back to its class, with interrupts disabled.
+// The first thread waiting for it only runs once we switched away, see csp_dispatch.
+static void csp_slab_release(csp_ctx ctx[static const 1])
+{
+	csp_wake_later(channel_pool_push(ctx->slab, (char *)ctx - CSP_SLAB_LINK));
+}
+#endif
+
+// Runs proc as a csp_func_t with a channel, as a thread_task_func_t without.
+static void *csp_call(const csp_func_param proc, const struct csp_params params[static const 1])
+{
+	DEBUG("args: %p, channel %p\n", params->args, (void*)params->c);
+	return (params->c) ? ((csp_func_t)proc)(params->args, params->c) : ((thread_task_func_t)proc)(params->args);
+}
+
 static void *csp_dispatch(void *args)
 {
 	DEBUG("%s:%zu: Dispatching process.\n", __func__, __LINE__);
@@ -491,11 +1610,19 @@ static void *csp_dispatch(void *args)
 	#pragma clang diagnostic pop
 #endif
 	csp_ctx *const ctx = args;
+	csp_procs[thread_getpid()] = ctx;
 
-	DEBUG("args: %p, channel %p\n", ctx->params.args, (void*)ctx->params.c);
-	ctx->retval = (ctx->params.c) ? ((csp_func_t)ctx->proc)(ctx->params.args, ctx->params.c) : ((thread_task_func_t)ctx->proc)(ctx->params.args);
+	ctx->retval = csp_call(ctx->proc, &ctx->params);
 	DEBUG("%s:%zu: Process returned [%p].\n", __func__, __LINE__, ctx->retval);
-	ctx->flags |= CSP_STOP;
+	// Left disabled: The joiners only run once sched_task_exit switched away, in one switch,
+	// and nobody takes a slab stack we still run on.
+	irq_disable();
+	csp_trace(CSP_TRACE_EXIT, ctx, 0);
+	csp_procs[thread_getpid()] = nullptr;
+	csp_exit(ctx);
+#ifdef CSP_SLAB
+	if (ctx->slab) { csp_slab_release(ctx); }
+#endif
 	sched_task_exit();
 	return ctx->retval;
 }
@@ -508,15 +1635,19 @@ static size_t csp_count = 0;
 // 	size_t thread_default_stack_size;
 // } _csp_internal_ctx = {0};
 
-#if __STDC_VERSION__ > 201710L
-static constexpr short csp_ctx_size = (sizeof (csp_ctx) + alignof (csp_ctx) - 1) & ~(alignof (csp_ctx) - 1);
-#else
-#define csp_ctx_size (sizeof (csp_ctx) + alignof (csp_ctx) - 1) & ~(alignof (csp_ctx) - 1)
-#endif
 
 csp_ctx *_csp(
 	struct csp_stack sp,
-    csp_func_param f,
+	csp_func_param f,
+	channel *const restrict c,
+	void *args
+)
+{ return _csp_wg(nullptr, sp, f, c, args); }
+
+csp_ctx *_csp_wg(
+	csp_waitgroup *const wg,
+	struct csp_stack sp,
+	csp_func_param f,
 	channel *const restrict c,
 	void *args
 )
@@ -524,6 +1655,16 @@ csp_ctx *_csp(
 #if __clang__
 	#pragma clang diagnostic push
 	#pragma clang diagnostic ignored "-Wsign-conversion"
+#endif
+#ifdef CSP_SLAB
+	channel_pool *slab = nullptr;
+	if (!sp.stackp) {
+		sp = csp_slab_take(sp.size, &slab);
+		if (!sp.stackp) {
+			DEBUG("%s:%zu: ERROR: No slab stack for the process\n", __func__, __LINE__);
+			return nullptr;
+		}
+	}
 #endif
 	assert(((int)sp.size - sizeof (csp_ctx)) > 0 && "Stack size too smol");
 	DEBUG("%s:%zu: Creating new process.\n", __func__, __LINE__);
@@ -537,11 +1678,17 @@ csp_ctx *_csp(
 			c,
 		},
 		nullptr,
+		{ nullptr },
+		wg,
 		//THREAD_STACKSIZE_CSP,
 		// {0},
 #ifdef CONFIG_THREAD_NAMES
 		{0},
 #endif
+#ifdef CSP_SLAB
+		slab,
+#endif
+		0,
 	};
 
 #ifdef CONFIG_THREAD_NAMES
@@ -555,11 +1702,13 @@ csp_ctx *_csp(
 #endif
 
 #endif
+	// Counted before it starts, it may well be done before we return.
+	if (wg) { csp_waitgroup_add(wg, 1); }
 	ctx->id = thread_create(
 		(sp.stackp)+(csp_ctx_size),
 		(int)(sp.size - (csp_ctx_size)),
 		CSP_PRIORITY,
-		THREAD_FLAGS_CSP,
+		THREAD_FLAGS_CSP | THREAD_CREATE_SLEEPING,
 		csp_dispatch,
 		ctx,
 #ifdef CONFIG_THREAD_NAMES
@@ -568,6 +1717,10 @@ csp_ctx *_csp(
 		nullptr
 #endif
 	);
+#ifdef CSP_SLAB
+	if (ctx->id < 0 && slab) { channel_pool_free(slab, (char *)ctx - CSP_SLAB_LINK); }
+#endif
+	if (ctx->id < 0 && wg) { csp_waitgroup_done(wg); }
 	switch (ctx->id) {
 		case -EINVAL: {
 			DEBUG("%s:%zu: ERROR: THREAD INVALID - CSP cannot create thread due to priority being greater than SCHED_PRIO_LEVELS, error code %d\n", __func__, __LINE__, ctx->id);
@@ -579,6 +1732,9 @@ csp_ctx *_csp(
 		};
 	}
 	DEBUG("%s:%zu: Finished creating process %d.\n", __func__, __LINE__, ctx->id);
+	// Created asleep: The process preempts us once woken, and a short one would record its exit before the spawn.
+	csp_trace(CSP_TRACE_SPAWN, ctx, (uint32_t)ctx->id);
+	thread_wakeup(ctx->id);
 	return ctx;
 }
 
@@ -589,15 +1745,161 @@ void csp_stop(csp_ctx ctx[static const restrict 1]);
 void csp_wait(csp_ctx ctx[static const restrict 1]);
 
 int csp_kill(csp_ctx ctx[static const restrict 1]) {
-	ctx->flags &= ~CSP_RUNNING;
-	sched_set_status(thread_get(ctx->id), STATUS_ZOMBIE);
-	return thread_kill_zombie(ctx->id);
+	unsigned state = irq_disable();
+	// Returned or killed before: Its wait group is done already and the pid may belong to another thread by now.
+	thread_t *const thread = (ctx->flags & CSP_RUNNING) ? thread_get(ctx->id) : nullptr;
+	if (!thread) {
+		irq_restore(state);
+		return STATUS_NOT_FOUND;
+	}
+	// Its waiters and timers live on its stack, linked into channels and timer lists we cannot take them out of.
+	if (ctx->waits) {
+		irq_restore(state);
+		return 0;
+	}
+	csp_procs[ctx->id] = nullptr;
+	csp_exit(ctx);
+	sched_set_status(thread, STATUS_ZOMBIE);
+	const int killed = thread_kill_zombie(ctx->id);
+#ifdef CSP_SLAB
+	if (killed == 1 && ctx->slab) { csp_slab_release(ctx); }
+#endif
+	irq_restore(state);
+	// The joiners readied above run now, if they come first.
+	thread_yield_higher();
+	return killed;
+}
+
+bool csp_running(csp_ctx ctx[static const restrict 1])
+{ return (ctx->flags & CSP_RUNNING); }
+
+/* JOIN */
+
+// Gives up before waiting once *expired is set, if expired is given.
+static bool _csp_join(csp_ctx ctx[static const restrict 1], void **const retval, const volatile bool *const expired)
+{
+	unsigned state = irq_disable();
+	/* Synchronization point: Sleep until the process is done, see csp_exit. */
+	while (ctx->flags & CSP_RUNNING) {
+		if (irq_is_in() || (expired && *expired)) {
+			irq_restore(state);
+			return false;
+		}
+		channel_waiter w = { .thread = thread_get_active() };
+		state = channel_park(&ctx->joiners, &w, state);
+	}
+	irq_restore(state);
+	if (retval) { *retval = ctx->retval; }
+	return true;
+}
+
+bool csp_join(csp_ctx ctx[static const restrict 1], void **const retval)
+{ return _csp_join(ctx, retval, nullptr); }
+
+#if IS_USED(MODULE_ZTIMER)
+bool csp_join_timeout(csp_ctx ctx[static const restrict 1], void **const retval, ztimer_clock_t *const clock, const uint32_t timeout)
+{
+	channel_deadline d;
+	channel_deadline_set(&d, clock, timeout);
+	const bool joined = _csp_join(ctx, retval, &d.expired);
+	channel_deadline_clear(&d, clock);
+	return joined;
+}
+#endif
+
+/* WAIT GROUP */
+
+void csp_waitgroup_add(csp_waitgroup wg[static const restrict 1], const unsigned n)
+{
+	const unsigned state = irq_disable();
+	wg->count += n;
+	irq_restore(state);
+}
+
+void csp_waitgroup_done(csp_waitgroup wg[static const restrict 1])
+{
+	const unsigned state = irq_disable();
+	csp_waitgroup_count_down(wg);
+	irq_restore(state);
+	// The waiters readied by the last done run now, if they come first.
+	thread_yield_higher();
+}
+
+bool csp_waitgroup_wait(csp_waitgroup wg[static const restrict 1])
+{
+	unsigned state = irq_disable();
+	/* Synchronization point: Sleep until the last done, see csp_waitgroup_count_down. */
+	while (wg->count) {
+		if (irq_is_in()) {
+			irq_restore(state);
+			return false;
+		}
+		channel_waiter w = { .thread = thread_get_active() };
+		state = channel_park(&wg->waiters, &w, state);
+	}
+	irq_restore(state);
+	return true;
 }
 
-bool csp_running(csp_ctx ctx[static const restrict 1]) {
-  if (ctx->flags & CSP_RUNNING) {
-    thread_yield(); // Synchronization point
-    return true;
-  }
-  return false;
+/* WORKER POOL */
+
+static void *csp_pool_worker(void *arg)
+{
+	csp_pool *const p = arg;
+	csp_task task;
+	// A closed queue receives nothing, once the queued tasks are done.
+	while (channel_recv(&p->queue, &task)) {
+		csp_call(task.proc, &task.params);
+	}
+	DEBUG("%s:%zu: Worker %d exits.\n", __func__, __LINE__, thread_getpid());
+	csp_trace(CSP_TRACE_EXIT, p, 0);
+	return nullptr;
 }
+
+size_t csp_pool_init(
+	csp_pool p[static const restrict 1],
+	const size_t worker_count,
+	const size_t stack_size,
+	char stacks[static const worker_count * stack_size],
+	const size_t queue_size,
+	rb_buftype queue[static const queue_size]
+)
+{
+	// One queue as both files: With channel_set_mpmc everyone sends and receives on the creator's send file.
+	// The receive file keeps its counters at 0 and never touches the storage, so sharing it is safe.
+	channel_make_fixed(&p->queue, true, sizeof (csp_task), queue_size, queue, queue_size, queue);
+	channel_set_mpmc(&p->queue);
+	p->workers = 0;
+	for (size_t i = 0; i != worker_count; ++i) {
+		const kernel_pid_t id = thread_create(
+			&stacks[i * stack_size],
+			(int)stack_size,
+			CSP_PRIORITY,
+			THREAD_FLAGS_CSP,
+			csp_pool_worker,
+			p,
+			"csp_pool"
+		);
+		if (id < 0) {
+			DEBUG("%s:%zu: ERROR: Worker %zu not started, error code %d\n", __func__, __LINE__, i, id);
+			break;
+		}
+		csp_trace(CSP_TRACE_SPAWN, p, (uint32_t)id);
+		++p->workers;
+	}
+	return p->workers;
+}
+
+bool csp_pool_submit(csp_pool p[static const restrict 1], const csp_func_param f, channel *const c, void *const args)
+{
+	const csp_task task = { f, { args, c } };
+	return channel_send(&p->queue, &task, sizeof (task));
+}
+
+bool csp_pool_try_submit(csp_pool p[static const restrict 1], const csp_func_param f, channel *const c, void *const args)
+{
+	const csp_task task = { f, { args, c } };
+	return channel_try_send(&p->queue, &task, sizeof (task));
+}
+
+void csp_pool_close(csp_pool p[static const restrict 1]);
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     module_csp
+ * @{
+ *
+ * @file
+ * @brief       Coroutines on a carrier thread and their channels.
+ *				Built with USECORO=1, which defines CSP_CORO.
+ *
+ * @author      Jonathan L. Claudius <jcl005@uit.no>
+ *
+ * @}
+ */
+
+#include "csp_coro.h"
+
+#ifdef CSP_CORO
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sched.h"
+
+// The carrier each thread runs, to find the coroutine calling.
+static csp_carrier *csp_carriers[KERNEL_PID_LAST + 1];
+
+/* CONTEXT SWITCH */
+
+#if defined(CPU_NATIVE)
+static void csp_coro_swap(csp_coro_context save[static const 1], csp_coro_context load[static const 1])
+{ swapcontext(save, load); }
+
+static void csp_coro_entry(void);
+
+static void csp_coro_prepare(csp_coro co[static const 1], char *const stack, const size_t stack_size)
+{
+	getcontext(&co->context);
+	co->context.uc_stack.ss_sp = stack;
+	co->context.uc_stack.ss_size = stack_size;
+	co->context.uc_link = NULL;
+	makecontext(&co->context, csp_coro_entry, 0);
+}
+#else
+// Callee saved registers onto the stack we leave, and off the stack we go to, returning into it.
+__attribute__((naked))
+static void csp_coro_swap(csp_coro_context save[static const 1], csp_coro_context load[static const 1])
+{
+	__asm__ volatile (
+		"push {r4-r11, lr}\n"
+#if defined(__ARM_FP) && !defined(__SOFTFP__)
+		"vpush {s16-s31}\n"
+#endif
+		"mov r2, sp\n"
+		"str r2, [r0]\n"
+		"ldr r2, [r1]\n"
+		"mov sp, r2\n"
+#if defined(__ARM_FP) && !defined(__SOFTFP__)
+		"vpop {s16-s31}\n"
+#endif
+		"pop {r4-r11, pc}\n"
+	);
+}
+
+static void csp_coro_entry(void);
+
+// The frame csp_coro_swap pops: Zeroed registers, and csp_coro_entry to return into.
+static void csp_coro_prepare(csp_coro co[static const 1], char *const stack, const size_t stack_size)
+{
+	uint32_t *sp = (uint32_t *)((uintptr_t)(stack + stack_size) & ~(uintptr_t)7);
+	*--sp = (uint32_t)(uintptr_t)csp_coro_entry;
+	for (size_t i = 0; i != 8; ++i) { *--sp = 0; }	 // r4-r11
+#if defined(__ARM_FP) && !defined(__SOFTFP__)
+	for (size_t i = 0; i != 16; ++i) { *--sp = 0; }	 // s16-s31
+#endif
+	co->context = sp;
+}
+#endif
+
+/* SCHEDULING */
+
+static void csp_coro_queue_push(csp_coro_queue q[static const 1], csp_coro co[static const 1])
+{
+	co->next = NULL;
+	if (q->tail) { q->tail->next = co; }
+	else { q->head = co; }
+	q->tail = co;
+}
+
+static csp_coro *csp_coro_queue_pop(csp_coro_queue q[static const 1])
+{
+	csp_coro *const co = q->head;
+	if (co) {
+		q->head = co->next;
+		if (!q->head) { q->tail = NULL; }
+	}
+	return co;
+}
+
+csp_coro *csp_coro_self(void)
+{
+	const csp_carrier *const carrier = csp_carriers[thread_getpid()];
+	return carrier ? carrier->current : NULL;
+}
+
+static void csp_coro_ready(csp_coro co[static const 1])
+{ csp_coro_queue_push(&co->carrier->ready, co); }
+
+// Back to the carrier, which runs the next ready coroutine. Returns once this one is ready and picked again.
+static void csp_coro_suspend(csp_coro co[static const 1])
+{ csp_coro_swap(&co->context, &co->carrier->context); }
+
+// Waits in q until the other side hands over or the channel closes.
+static void csp_coro_park(csp_coro_queue q[static const 1], csp_coro co[static const 1])
+{
+	csp_coro_queue_push(q, co);
+	csp_coro_suspend(co);
+}
+
+static void csp_coro_entry(void)
+{
+	csp_coro *const co = csp_coro_self();
+	co->retval = (co->params.c)
+		? ((csp_func_t)co->proc)(co->params.args, co->params.c)
+		: ((thread_task_func_t)co->proc)(co->params.args);
+	co->done = true;
+	--co->carrier->coros;
+	// Never comes back, the carrier forgets about it.
+	csp_coro_suspend(co);
+}
+
+csp_coro *csp_coro_spawn(
+	csp_carrier carrier[static const restrict 1],
+	char *const stack,
+	const size_t stack_size,
+	const csp_func_param f,
+	channel *const c,
+	void *const args
+)
+{
+	const size_t coro_size = (sizeof (csp_coro) + alignof (csp_coro) - 1) & ~(alignof (csp_coro) - 1);
+	if (stack_size <= coro_size) { return NULL; }
+	csp_coro *const co = (void *)stack;
+	*co = (csp_coro){ .carrier = carrier, .proc = f, .params = { args, c } };
+	csp_coro_prepare(co, stack + coro_size, stack_size - coro_size);
+	++carrier->coros;
+	csp_coro_ready(co);
+	return co;
+}
+
+size_t csp_carrier_run(csp_carrier carrier[static const restrict 1])
+{
+	csp_carrier **const slot = &csp_carriers[thread_getpid()];
+	csp_carrier *const outer = *slot;
+	*slot = carrier;
+	for (csp_coro *co; (co = csp_coro_queue_pop(&carrier->ready)); ) {
+		carrier->current = co;
+		csp_coro_swap(&carrier->context, &co->context);
+		carrier->current = NULL;
+	}
+	*slot = outer;
+	return carrier->coros;
+}
+
+void csp_coro_yield(void)
+{
+	csp_coro *const co = csp_coro_self();
+	if (!co) {
+		thread_yield();
+		return;
+	}
+	csp_coro_ready(co);
+	csp_coro_suspend(co);
+}
+
+/* CHANNELS */
+
+void csp_coro_chan_make(csp_coro_chan ch[static const restrict 1], const size_t size, void *const buf)
+{
+	*ch = (csp_coro_chan){ 0 };
+	if (size) { csp_ring_init(&ch->rb, buf, (unsigned)size); }
+}
+
+// Queues the message of the first waiting sender if it fits, and readies the sender.
+static void csp_coro_chan_refill(csp_coro_chan ch[static const restrict 1])
+{
+	csp_coro *const s = ch->senders.head;
+	if (!s || !ch->rb.size || csp_ring_free(&ch->rb) < sizeof (size_t) + s->data_size) { return; }
+	csp_coro_queue_pop(&ch->senders);
+	csp_ring_put(&ch->rb, 0, &s->data_size, sizeof (size_t));
+	csp_ring_put(&ch->rb, sizeof (size_t), s->data, (unsigned)s->data_size);
+	csp_ring_publish(&ch->rb, (unsigned)(sizeof (size_t) + s->data_size));
+	s->handed = true;
+	csp_coro_ready(s);
+}
+
+size_t csp_coro_send(csp_coro_chan ch[static const restrict 1], const void *const data, const size_t data_size)
+{
+	if (ch->closed || !data_size) { return 0; }
+	csp_coro *const r = csp_coro_queue_pop(&ch->receivers);
+	if (r) {
+		// A receiver only waits on an empty buffer, so the message goes straight to it.
+		memcpy(r->data, data, data_size);
+		r->data_size = data_size;
+		r->handed = true;
+		csp_coro_ready(r);
+		return data_size;
+	}
+	// Behind the senders already waiting, in order.
+	if (!ch->senders.head && ch->rb.size && csp_ring_free(&ch->rb) >= sizeof (size_t) + data_size) {
+		csp_ring_put(&ch->rb, 0, &data_size, sizeof (size_t));
+		csp_ring_put(&ch->rb, sizeof (size_t), data, (unsigned)data_size);
+		csp_ring_publish(&ch->rb, (unsigned)(sizeof (size_t) + data_size));
+		return data_size;
+	}
+	csp_coro *const co = csp_coro_self();
+	assert(co && "Only coroutines wait on a coroutine channel");
+	co->data = (void *)(uintptr_t)data;
+	co->data_size = data_size;
+	co->handed = false;
+	csp_coro_park(&ch->senders, co);
+	return co->handed ? data_size : 0;
+}
+
+size_t csp_coro_recv(csp_coro_chan ch[static const restrict 1], void *const buffer)
+{
+	if (ch->rb.size && !csp_ring_empty(&ch->rb)) {
+		size_t data_size = 0;
+		csp_ring_get(&ch->rb, &data_size, sizeof (size_t));
+		csp_ring_get(&ch->rb, buffer, (unsigned)data_size);
+		csp_coro_chan_refill(ch);
+		return data_size;
+	}
+	csp_coro *const s = csp_coro_queue_pop(&ch->senders);
+	if (s) {
+		memcpy(buffer, s->data, s->data_size);
+		s->handed = true;
+		csp_coro_ready(s);
+		return s->data_size;
+	}
+	if (ch->closed) { return 0; }
+	csp_coro *const co = csp_coro_self();
+	assert(co && "Only coroutines wait on a coroutine channel");
+	co->data = buffer;
+	co->data_size = 0;
+	co->handed = false;
+	csp_coro_park(&ch->receivers, co);
+	return co->handed ? co->data_size : 0;
+}
+
+void csp_coro_close(csp_coro_chan ch[static const restrict 1])
+{
+	ch->closed = true;
+	for (csp_coro *co; (co = csp_coro_queue_pop(&ch->senders)); ) { csp_coro_ready(co); }
+	for (csp_coro *co; (co = csp_coro_queue_pop(&ch->receivers)); ) { csp_coro_ready(co); }
+}
+#endif
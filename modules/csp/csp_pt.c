@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     module_csp
+ * @{
+ *
+ * @file
+ * @brief       Dispatcher of the stackless processes.
+ *
+ * @author      Jonathan L. Claudius <jcl005@uit.no>
+ *
+ * @}
+ */
+
+#include "csp_pt.h"
+#include "csp_trace.h"
+
+#define ENABLE_DEBUG 0
+#include "debug.h"
+#include "irq.h"
+#include "thread.h"
+
+#include <stdint.h>
+
+static void csp_pt_ready(csp_pt_dispatcher d[static const restrict 1], csp_pt pt[static const restrict 1])
+{
+	pt->next = NULL;
+	if (d->ready) { d->ready_last->next = pt; }
+	else { d->ready = pt; }
+	d->ready_last = pt;
+}
+
+static csp_pt *csp_pt_ready_pop(csp_pt_dispatcher d[static const restrict 1])
+{
+	csp_pt *const pt = d->ready;
+	if (pt) { d->ready = pt->next; }
+	return pt;
+}
+
+static void csp_pt_take(csp_pt_dispatcher d[static const restrict 1], csp_pt pt[static const restrict 1])
+{
+	++d->count;
+	csp_trace(CSP_TRACE_SPAWN, pt, (uint32_t)d->pid);
+	csp_pt_ready(d, pt);
+}
+
+// Runs pt until it blocks on a channel that is not ready, yields or exits.
+static void csp_pt_resume(csp_pt_dispatcher d[static const restrict 1], csp_pt pt[static const restrict 1])
+{
+	while (true) {
+		switch (pt->f(pt)) {
+		case CSP_PT_WAITING: {
+			channel_case k = (pt->send)
+				? CHANNEL_CASE_SEND(pt->c, pt->data, pt->data_size)
+				: CHANNEL_CASE_RECV(pt->c, pt->data);
+			// Ready straight away, carry on without going through the dispatcher.
+			if (!channel_select(1, &k, true)) {
+				pt->data_size = k.data_size;
+				continue;
+			}
+			d->cases[d->waiting] = k;
+			d->blocked[d->waiting] = pt;
+			++d->waiting;
+			return;
+		}
+		case CSP_PT_YIELDED:
+			csp_pt_ready(d, pt);
+			return;
+		default:
+			DEBUG("%s:%zu: Process %p exits.\n", __func__, __LINE__, (void *)pt);
+			csp_trace(CSP_TRACE_EXIT, pt, 0);
+			pt->f = NULL;
+			--d->count;
+			return;
+		}
+	}
+}
+
+static void *csp_pt_dispatch(void *arg)
+{
+	csp_pt_dispatcher *const d = arg;
+	d->pid = thread_getpid();
+	bool closed = false;
+
+	while (true) {
+		// Whatever is ready goes first, then one round of waiting, without sleeping while something is ready.
+		for (csp_pt *pt; (pt = csp_pt_ready_pop(d)); ) { csp_pt_resume(d, pt); }
+		const size_t n = d->waiting;
+		const bool accept = !closed && d->count != d->capacity;
+		if (!n && !accept) {
+			if (d->ready) { continue; }
+			break;
+		}
+		if (accept) { d->cases[n] = CHANNEL_CASE_RECV(&d->spawns, &d->spawned); }
+		const size_t i = channel_select(n + accept, d->cases, d->ready);
+		if (i == n + accept) { continue; }
+		if (i == n) {
+			// Closed and drained, no more spawns.
+			if (!d->cases[n].data_size) { closed = true; }
+			else { csp_pt_take(d, d->spawned); }
+			continue;
+		}
+		csp_pt *const pt = d->blocked[i];
+		pt->data_size = d->cases[i].data_size;
+		// The last one blocked fills the gap.
+		--d->waiting;
+		d->cases[i] = d->cases[d->waiting];
+		d->blocked[i] = d->blocked[d->waiting];
+		csp_pt_resume(d, pt);
+	}
+	DEBUG("%s:%zu: Dispatcher %d exits.\n", __func__, __LINE__, thread_getpid());
+	csp_trace(CSP_TRACE_EXIT, d, 0);
+	return NULL;
+}
+
+kernel_pid_t csp_pt_dispatcher_init(
+	csp_pt_dispatcher d[static const restrict 1],
+	const size_t capacity,
+	channel_case cases[static const capacity + 1],
+	csp_pt *blocked[static const capacity],
+	const size_t stack_size,
+	char stack[static const stack_size],
+	const size_t queue_size,
+	rb_buftype queue[static const queue_size]
+)
+{
+	*d = (csp_pt_dispatcher){ .cases = cases, .blocked = blocked, .capacity = capacity, .pid = KERNEL_PID_UNDEF };
+	// One queue as both files, like the queue of a csp_pool: With channel_set_mpmc, spawners send and the dispatcher
+	// receives on the creator's send file. The receive file never touches the storage.
+	channel_make_fixed(&d->spawns, true, sizeof (csp_pt *), queue_size, queue, queue_size, queue);
+	channel_set_mpmc(&d->spawns);
+	const kernel_pid_t id = thread_create(stack, (int)stack_size, CSP_PRIORITY, THREAD_FLAGS_CSP, csp_pt_dispatch, d, "csp_pt");
+	if (id < 0) {
+		DEBUG("%s:%zu: ERROR: Dispatcher not started, error code %d\n", __func__, __LINE__, id);
+		return id;
+	}
+	csp_trace(CSP_TRACE_SPAWN, d, (uint32_t)id);
+	return id;
+}
+
+static void csp_pt_init(csp_pt pt[static const restrict 1], const csp_pt_func f, channel *const c, void *const args)
+{ *pt = (csp_pt){ .f = f, .params = { args, c } }; }
+
+bool csp_pt_spawn(csp_pt_dispatcher d[static const restrict 1], csp_pt pt[static const restrict 1], const csp_pt_func f, channel *const c, void *const args)
+{
+	// The dispatcher cannot wait for itself to take the spawn.
+	if (thread_getpid() == d->pid) { return csp_pt_try_spawn(d, pt, f, c, args); }
+	csp_pt_init(pt, f, c, args);
+	csp_pt *const spawn = pt;
+	return channel_send(&d->spawns, &spawn, sizeof (spawn));
+}
+
+bool csp_pt_try_spawn(csp_pt_dispatcher d[static const restrict 1], csp_pt pt[static const restrict 1], const csp_pt_func f, channel *const c, void *const args)
+{
+	if (thread_getpid() == d->pid && !irq_is_in()) {
+		if (channel_is_send_closed(&d->spawns) || d->count == d->capacity) { return false; }
+		csp_pt_init(pt, f, c, args);
+		csp_pt_take(d, pt);
+		return true;
+	}
+	csp_pt_init(pt, f, c, args);
+	csp_pt *const spawn = pt;
+	return channel_try_send(&d->spawns, &spawn, sizeof (spawn));
+}
+
+size_t csp_pt_bytes(const csp_pt pt[static const restrict 1]);
+bool csp_pt_running(const csp_pt pt[static const restrict 1]);
+void csp_pt_dispatcher_close(csp_pt_dispatcher d[static const restrict 1]);
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     module_csp
+ * @{
+ *
+ * @file
+ * @brief       Ringbuffer behind CSP channels.
+ *
+ * @author      Jonathan L. Claudius <jcl005@uit.no>
+ *
+ * @}
+ */
+
+#include "csp_ring.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* Both counters run freely and wrap with unsigned arithmetic, masked into the buffer on access.
+ * The side moving a counter loads its own relaxed and the other acquire, and stores its own release,
+ * so the bytes behind a published counter are visible to the other side before the counter is. */
+
+// Word sized accesses that may alias the bytes of any payload.
+typedef unsigned csp_ring_word __attribute__((__may_alias__));
+
+// Word by word when both ends and the size are word aligned, which most structs and the size headers are.
+// Saves the call and alignment checks of memcpy on the short messages channels mostly carry.
+static inline void csp_ring_copy(void *restrict dst, const void *restrict src, size_t n)
+{
+	if (!(((uintptr_t)dst | (uintptr_t)src | n) & (sizeof (csp_ring_word) - 1))) {
+		csp_ring_word *d = dst;
+		const csp_ring_word *s = src;
+		for (n /= sizeof (csp_ring_word); n; --n) { *d++ = *s++; }
+		return;
+	}
+	memcpy(dst, src, n);
+}
+
+// Copies n bytes into the ring at counter pos, up to the wrap and then from the start.
+static void csp_ring_write(const csp_ring_t rb[static const 1], const unsigned pos, const unsigned char *src, const unsigned n)
+{
+	const unsigned at = pos & (rb->size - 1);
+	const unsigned first = (n < rb->size - at) ? n : rb->size - at;
+	csp_ring_copy(&rb->buf[at], src, first);
+	if (first != n) { csp_ring_copy(rb->buf, &src[first], n - first); }
+}
+
+// Copies n bytes out of the ring at counter pos, up to the wrap and then from the start.
+static void csp_ring_read(const csp_ring_t rb[static const 1], const unsigned pos, unsigned char *dst, const unsigned n)
+{
+	const unsigned at = pos & (rb->size - 1);
+	const unsigned first = (n < rb->size - at) ? n : rb->size - at;
+	csp_ring_copy(dst, &rb->buf[at], first);
+	if (first != n) { csp_ring_copy(&dst[first], rb->buf, n - first); }
+}
+
+void csp_ring_init(csp_ring_t rb[static const 1], void *buf, unsigned size)
+{
+	// Round down to a power of two so a mask finds the position.
+	while (size & (size - 1)) { size &= size - 1; }
+	rb->buf = buf;
+	rb->size = size;
+	CSP_RING_STORE(rb->reads, 0, relaxed);
+	CSP_RING_STORE(rb->writes, 0, relaxed);
+}
+
+void csp_ring_put(csp_ring_t rb[static const 1], const unsigned offset, const void *const data, const unsigned n)
+{
+	if (!n) { return; }
+	csp_ring_write(rb, CSP_RING_LOAD(rb->writes, relaxed) + offset, data, n);
+}
+
+void csp_ring_publish(csp_ring_t rb[static const 1], const unsigned n)
+{
+	const unsigned writes = CSP_RING_LOAD(rb->writes, relaxed);
+	CSP_RING_STORE(rb->writes, writes + n, release);
+}
+
+unsigned csp_ring_add(csp_ring_t rb[static const 1], const void *const data, unsigned n)
+{
+	const unsigned room = csp_ring_free(rb);
+	if (n > room) { n = room; }
+	csp_ring_put(rb, 0, data, n);
+	csp_ring_publish(rb, n);
+	return n;
+}
+
+int csp_ring_add_one(csp_ring_t rb[static const 1], const unsigned char c)
+{ return (csp_ring_add(rb, &c, 1)) ? 0 : -1; }
+
+unsigned csp_ring_peek(const csp_ring_t rb[static const 1], void *const data, unsigned n)
+{
+	const unsigned used = csp_ring_used(rb);
+	if (n > used) { n = used; }
+	if (n) { csp_ring_read(rb, CSP_RING_LOAD(rb->reads, relaxed), data, n); }
+	return n;
+}
+
+int csp_ring_peek_one(const csp_ring_t rb[static const 1])
+{
+	unsigned char c;
+	return (csp_ring_peek(rb, &c, 1)) ? c : -1;
+}
+
+unsigned csp_ring_drop(csp_ring_t rb[static const 1], unsigned n)
+{
+	const unsigned used = csp_ring_used(rb);
+	if (n > used) { n = used; }
+	const unsigned reads = CSP_RING_LOAD(rb->reads, relaxed);
+	CSP_RING_STORE(rb->reads, reads + n, release);
+	return n;
+}
+
+unsigned csp_ring_get(csp_ring_t rb[static const 1], void *const data, const unsigned n)
+{ return csp_ring_drop(rb, csp_ring_peek(rb, data, n)); }
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     module_csp
+ * @{
+ *
+ * @file
+ * @brief       Channel statistics and the csp shell command.
+ *				Counted by csp.c when built with USESTATS=1, which defines CSP_STATS.
+ *
+ * @author      Jonathan L. Claudius <jcl005@uit.no>
+ *
+ * @}
+ */
+
+#include "csp.h"
+#include "irq.h"
+
+#ifdef CSP_STATS
+#include <inttypes.h>
+#include <stdio.h>
+
+#if IS_USED(MODULE_SHELL)
+#include "shell.h"
+#endif
+
+// Registered channels, newest first.
+static channel *channel_registry;
+
+void channel_register(channel c[static const restrict 1], const char *const name)
+{
+	unsigned state = irq_disable();
+	c->name = name;
+	channel **pos = &channel_registry;
+	while (*pos && *pos != c) { pos = &(*pos)->next_registered; }
+	if (!*pos) {
+		c->next_registered = channel_registry;
+		channel_registry = c;
+	}
+	irq_restore(state);
+}
+
+void channel_unregister(channel c[static const restrict 1])
+{
+	unsigned state = irq_disable();
+	for (channel **pos = &channel_registry; *pos; pos = &(*pos)->next_registered) {
+		if (*pos == c) {
+			*pos = c->next_registered;
+			break;
+		}
+	}
+	irq_restore(state);
+}
+
+channel *channel_registered(const channel *const prev)
+{ return (prev) ? prev->next_registered : channel_registry; }
+
+channel_stats channel_get_stats(const channel c[static const restrict 1])
+{
+	unsigned state = irq_disable();
+	const channel_stats stats = c->stats;
+	irq_restore(state);
+	return stats;
+}
+
+void channel_reset_stats(channel c[static const restrict 1])
+{
+	unsigned state = irq_disable();
+	c->stats = (channel_stats){ 0 };
+	irq_restore(state);
+}
+
+// Files as seen from the creator: > is what it sends, < what it receives.
+void channel_print_stats(void)
+{
+	printf("%-12s %8s %10s %8s %10s %6s %6s %8s %6s %9s %9s\n",
+		"channel", "msgs>", "bytes>", "msgs<", "bytes<", "sblk", "rblk", "switches", "part", "hw>", "hw<");
+	for (channel *c = channel_registered(NULL); c; c = channel_registered(c)) {
+		const channel_stats s = channel_get_stats(c);
+		printf("%-12s %8" PRIu32 " %10" PRIu32 " %8" PRIu32 " %10" PRIu32 " %6" PRIu32 " %6" PRIu32
+			" %8" PRIu32 " %6" PRIu32 " %4u/%-4u %4u/%-4u\n",
+			(c->name) ? c->name : "?",
+			s.msgs[1], s.bytes[1], s.msgs[0], s.bytes[0],
+			s.send_blocked, s.recv_blocked, s.switches, s.partial,
+			s.high_water[1], c->files[1].rb.size, s.high_water[0], c->files[0].rb.size);
+	}
+}
+
+#if IS_USED(MODULE_SHELL)
+static int csp_stats_cmd(int argc, char **argv)
+{
+	if (argc > 1 && argv[1][0] == 'r') {
+		for (channel *c = channel_registered(NULL); c; c = channel_registered(c)) { channel_reset_stats(c); }
+		return 0;
+	}
+	channel_print_stats();
+	return 0;
+}
+
+SHELL_COMMAND(csp, "List registered CSP channels with their statistics, 'csp reset' clears them", csp_stats_cmd);
+#endif
+#else
+void channel_register(channel c[static const restrict 1], const char *const name);
+void channel_unregister(channel c[static const restrict 1]);
+#endif
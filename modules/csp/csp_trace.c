@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     module_csp
+ * @{
+ *
+ * @file
+ * @brief       Event trace ring and its Chrome trace export.
+ *				Recorded by csp.c when built with USETRACE=1, which defines CSP_TRACE.
+ *
+ * @author      Jonathan L. Claudius <jcl005@uit.no>
+ *
+ * @}
+ */
+
+#include "csp_trace.h"
+
+#ifdef CSP_TRACE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sched.h"
+
+#if IS_USED(MODULE_SHELL)
+#include "shell.h"
+#endif
+
+csp_trace_event csp_trace_ring[CSP_TRACE_SIZE];
+unsigned csp_trace_next;
+
+void csp_trace_clear(void)
+{
+	unsigned state = irq_disable();
+	csp_trace_next = 0;
+	irq_restore(state);
+}
+
+// Starts and ends make duration slices of the sends and receives, the rest are instants on the thread.
+static const struct {
+	const char *name;
+	char phase;
+} csp_trace_kinds[] = {
+	[CSP_TRACE_SPAWN] = { "spawn", 'i' },
+	[CSP_TRACE_EXIT] = { "exit", 'i' },
+	[CSP_TRACE_SEND_START] = { "send", 'B' },
+	[CSP_TRACE_SEND_END] = { "send", 'E' },
+	[CSP_TRACE_RECV_START] = { "recv", 'B' },
+	[CSP_TRACE_RECV_END] = { "recv", 'E' },
+	[CSP_TRACE_SCHED_SELF] = { "sleep", 'i' },
+	[CSP_TRACE_SCHED_OTHER] = { "wake", 'i' },
+	[CSP_TRACE_CLOSE] = { "close", 'i' },
+};
+
+void csp_trace_write(FILE *const out)
+{
+	fputs("{\"traceEvents\":[\n", out);
+	// Thread names for the threads still around, ids are RIOT pids.
+	for (kernel_pid_t pid = KERNEL_PID_FIRST; pid <= KERNEL_PID_LAST; ++pid) {
+		if (!thread_get(pid)) { continue; }
+		const char *const name = thread_getname(pid);
+		fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+			(int)pid, (name) ? name : "?");
+	}
+	unsigned state = irq_disable();
+	const unsigned next = csp_trace_next;
+	irq_restore(state);
+	const char *sep = "";
+	for (unsigned i = (next > CSP_TRACE_SIZE) ? next - CSP_TRACE_SIZE : 0; i != next; ++i) {
+		// Copied out one at a time, tracing goes on meanwhile and skips what got overwritten.
+		state = irq_disable();
+		const bool lost = csp_trace_next - i > CSP_TRACE_SIZE;
+		const csp_trace_event e = csp_trace_ring[i & (CSP_TRACE_SIZE - 1)];
+		irq_restore(state);
+		if (lost || e.kind >= ARRAY_SIZE(csp_trace_kinds)) { continue; }
+		fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"csp\",\"ph\":\"%c\",%s\"ts\":%" PRIu32 ",\"pid\":1,\"tid\":%d,"
+			"\"args\":{\"obj\":\"%p\",\"arg\":%" PRIu32 "}}",
+			sep, csp_trace_kinds[e.kind].name, csp_trace_kinds[e.kind].phase,
+			(csp_trace_kinds[e.kind].phase == 'i') ? "\"s\":\"t\"," : "",
+			e.time, (int)e.pid, e.obj, e.arg);
+		sep = ",\n";
+	}
+	fputs("\n]}\n", out);
+}
+
+#ifdef CPU_NATIVE
+int csp_trace_dump(const char *const path)
+{
+	FILE *const out = fopen(path, "w");
+	if (!out) { return -errno; }
+	csp_trace_write(out);
+	return (fclose(out)) ? -errno : 0;
+}
+#endif
+
+#if IS_USED(MODULE_SHELL)
+static int csp_trace_cmd(int argc, char **argv)
+{
+	if (argc < 2) {
+		csp_trace_write(stdout);
+		return 0;
+	}
+	if (!strcmp(argv[1], "clear")) {
+		csp_trace_clear();
+		return 0;
+	}
+#ifdef CPU_NATIVE
+	const int res = csp_trace_dump(argv[1]);
+	if (res) { printf("csp_trace: cannot write %s: %d\n", argv[1], res); }
+	return res;
+#else
+	puts("usage: csp_trace [clear]");
+	return 1;
+#endif
+}
+
+SHELL_COMMAND(csp_trace, "Print the CSP event trace as Chrome trace JSON, 'csp_trace clear' forgets it, 'csp_trace <file>' writes it on native", csp_trace_cmd);
+#endif
+#endif
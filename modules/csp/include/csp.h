@@ -25,34 +25,34 @@
 
 /* Add header includes here */
 #include "thread.h"
+#include "iolist.h"
+#include "kernel_defines.h"
+#include "list.h"
+#if IS_USED(MODULE_ZTIMER)
+#include "ztimer.h"
+#endif
 
-#ifdef TSRB
-#include "tsrb.h"
-#define RB_INIT(buf) TSRB_INIT(buf)
-#define rb_t tsrb_t
-#define rb_add tsrb_add
-#define rb_add_one tsrb_add_one
-#define rb_get tsrb_get
-#define rb_drop tsrb_drop
-#define rb_peek tsrb_peek
-#define rb_peek_one tsrb_peek_one
-#define rb_empty tsrb_empty
-#define rb_avail tsrb_avail
+// Channel ringbuffer, see csp_ring.h. TSRB makes its counters atomic for the lock-free SPSC mode, see channel_set_spsc.
+#include "csp_ring.h"
+#define RB_INIT(buf) CSP_RING_INIT(buf)
+#define RB_SIZE(size) CSP_RING_SIZE(size)
+#define rb_init csp_ring_init
+#define rb_t csp_ring_t
+#define rb_add csp_ring_add
+#define rb_add_one csp_ring_add_one
+#define rb_get csp_ring_get
+#define rb_drop csp_ring_drop
+#define rb_peek csp_ring_peek
+#define rb_peek_one csp_ring_peek_one
+#define rb_empty csp_ring_empty
+#define rb_avail csp_ring_free
+#define rb_used csp_ring_used
 #define rb_sizetype unsigned
+#ifdef TSRB
+#define rb_counttype atomic_uint
 #define rb_buftype unsigned char
 #else
-#include "ringbuffer.h"
-#define RB_INIT(buf) RINGBUFFER_INIT(buf)
-#define rb_t ringbuffer_t
-#define rb_add ringbuffer_add
-#define rb_add_one ringbuffer_add_one
-#define rb_get ringbuffer_get
-#define rb_drop ringbuffer_remove
-#define rb_peek ringbuffer_peek
-#define rb_peek_one ringbuffer_peek_one
-#define rb_empty ringbuffer_empty
-#define rb_avail ringbuffer_get_free
-#define rb_sizetype unsigned
+#define rb_counttype unsigned
 #define rb_buftype char
 #endif
 
@@ -77,6 +77,10 @@ enum CHANNEL_FLAGS
 	CHANNEL_BUFFERED = (1 << 1),
 	CHANNEL_SEND_READY = (1 << 2),
 	CHANNEL_RECV_READY = (1 << 3),
+	CHANNEL_COALESCED = (1 << 4),
+	CHANNEL_MPMC = (1 << 5),
+	CHANNEL_SPSC = (1 << 6),
+	CHANNEL_DRAINING = (1 << 7),
 };
 
 typedef struct channel_message channel_msg;
@@ -86,10 +90,39 @@ struct channel_message {
 };
 #define NEW_MSG(data, sz) (channel_msg) { (sz), (data) }
 
+// A thread waiting on a channel with its message, so the other side can copy straight across.
+// Lives on the waiting thread's stack for as long as it waits, queued by priority and then arrival.
+typedef struct channel_waiter channel_waiter;
+struct channel_waiter {
+	list_node_t node;
+	thread_t *thread;
+	const iolist_t *data;	 // Sender: data to send. Receiver: buffers to receive into.
+	size_t data_size;	 // Sender: size to send. Receiver: largest message it takes, 0 for any, then size received.
+	bool done;	 // Set by the other side once the message is copied.
+	bool *select_done;	 // Shared by all cases of a channel_select, nullptr otherwise.
+	bool woken;	 // Taken off its queue to have another look without a message, see channel_wake_first.
+};
+
+// Size of the ringbuffer storage embedded in every channel, per direction, rounded up to a power of two.
+// Set to 0 to drop the embedded storage and size every channel through channel_make_buf.
 #ifndef CHANNEL_BUFSIZE
 #define CHANNEL_BUFSIZE 32
 #endif
 
+#ifdef CSP_STATS
+// Counters of a channel, see channel_get_stats. Per file like channel_make_buf: [1] from the creator, [0] to the creator.
+typedef struct channel_stats channel_stats;
+struct channel_stats {
+	uint32_t msgs[2];	 // Messages sent into each file.
+	uint32_t bytes[2];	 // Bytes sent into each file.
+	uint32_t send_blocked;	 // Times a sender had to wait.
+	uint32_t recv_blocked;	 // Times a receiver had to wait.
+	uint32_t switches;	 // Threads woken by the channel, each a context switch once it runs.
+	uint32_t partial;	 // Messages received in part, the rest did not fit the receive buffers.
+	rb_sizetype high_water[2];	 // Most bytes ever queued in each file.
+};
+#endif
+
 typedef struct channel channel;
 struct channel {
 	// The channel should be created in the main function by the "parent thread".
@@ -98,18 +131,42 @@ struct channel {
 	kernel_pid_t creator;
 	int flags;
 
-	thread_t *thread_read_blocked;	 // The thread(s) waiting for reading.
-	thread_t *thread_write_blocked;	 // The thread(s) waiting for writing.
+	// Barriers only, see channel_send(c, nullptr, 0). Messages wait in the queues of their file.
+	thread_t *thread_read_blocked;	 // The thread waiting for reading.
+	thread_t *thread_write_blocked;	 // The thread waiting for writing.
+	// Senders blocked with a message, counted from parking until they run again, see channel_close_drain.
+	rb_sizetype senders_parked;
+
+	// Size of every message on a fixed size channel, 0 for variable sized messages.
+	// Fixed size messages are sent without the data size in front of them.
+	rb_sizetype elem_size;
+
+	// Wakeup coalescing on buffered channels, see channel_set_watermarks.
+	rb_sizetype high_watermark;	 // Wake the receiver once this many bytes are queued.
+	rb_sizetype wake_msgs;	 // Wake the receiver once this many messages are queued.
+	rb_sizetype low_watermark;	 // Wake the sender once no more than this many bytes are queued.
 
 	// A channel file.
 	// The channel needs two files to communicate. Each side has a read and a write end.
 	// These sides cross eachother depending on who is the parent/child.
 	// Because these things are local to the channel creation point,
 	// trying to copy the channel to send to another channel will not work.
+	// The ringbuffer either points into the embedded buffer (channel_make) or caller storage (channel_make_buf).
 	struct channel_file {
 		rb_t rb;
-		rb_buftype buffer[CHANNEL_BUFSIZE];
+		rb_counttype queued;	 // Messages in the buffer.
+		list_node_t senders;	 // Senders waiting with a message for this file.
+		list_node_t receivers;	 // Receivers waiting on this file.
+#if CHANNEL_BUFSIZE > 0
+		rb_buftype buffer[RB_SIZE(CHANNEL_BUFSIZE)];
+#endif
 	} files[2];
+
+#ifdef CSP_STATS
+	channel_stats stats;
+	const char *name;	 // See channel_register.
+	channel *next_registered;
+#endif
 };
 
 #if __clang__
@@ -125,10 +182,98 @@ inline channel *channel_from_args(void *arg) {
 #endif
 
 // Using array notation to get compile-time null check.
+#if CHANNEL_BUFSIZE > 0
 channel channel_make(channel c[static const restrict 1], const bool buffered);
+#endif
 
-// Recognize which side we're on and close that file.
+// Makes a channel on caller provided storage, sized per direction.
+// send is the file the creator writes to, recv the file the creator reads from.
+// Both sizes are rounded down to a power of two, the rest of the storage goes unused:
+// Size it with RB_SIZE, which rounds up, like CHANNEL_STATIC does.
+channel channel_make_buf(
+	channel c[static const restrict 1],
+	const bool buffered,
+	const size_t send_size,
+	rb_buftype send[static const send_size],
+	const size_t recv_size,
+	rb_buftype recv[static const recv_size]
+);
+
+/*
+ * Declares a channel with its own storage of at least size bytes per direction, rounded up to a power of two.
+ * The storage is static, so this works on file and block scope alike:
+	CHANNEL_STATIC(sensor, 256);
+	channel_make_static(sensor, true);
+ */
+#define CHANNEL_STATIC(name, size) \
+	static _Alignas (unsigned) rb_buftype name##_files[2][RB_SIZE(size)]; \
+	static channel name
+#define channel_make_static(name, buffered) \
+	channel_make_buf(&(name), (buffered), \
+		sizeof (name##_files[1]), name##_files[1], \
+		sizeof (name##_files[0]), name##_files[0])
+
+// Makes a channel of fixed size elements on caller provided storage, see channel_make_buf.
+// Messages are sent without a data size in front, so send sizes other than elem_size are refused.
+// N elements per direction take RB_SIZE(N * elem_size) bytes each, like CHANNEL_OF.
+channel channel_make_fixed(
+	channel c[static const restrict 1],
+	const bool buffered,
+	const size_t elem_size,
+	const size_t send_size,
+	rb_buftype send[static const send_size],
+	const size_t recv_size,
+	rb_buftype recv[static const recv_size]
+);
+
+/*
+ * Typed channel holding N elements of type T per direction.
+ * The union member type only carries T for the typed macros and costs no storage.
+	CHANNEL_OF(msg_t, 8) c;
+	channel_make_of(&c, true);
+	channel_send_of(&c, &m);
+	channel_recv_of(&c, &m);
+ * The channel member is the plain channel, usable with the rest of the interface and GO.
+ */
+#define CHANNEL_OF(T, N) \
+	struct { \
+		union { channel c; T *type; }; \
+		rb_buftype files[2][RB_SIZE((N) * sizeof (T))]; \
+	}
+#define channel_make_of(tc, buffered) \
+	channel_make_fixed(&(tc)->c, (buffered), sizeof (*(tc)->type), \
+		sizeof ((tc)->files[1]), (tc)->files[1], \
+		sizeof ((tc)->files[0]), (tc)->files[0])
+
+#if __STDC_VERSION__ > 201710L
+#define CHANNEL_OF_SEND_PTR(tc, ptr) ((const typeof (*(tc)->type) *){0} = (ptr))
+#define CHANNEL_OF_RECV_PTR(tc, ptr) ((typeof ((tc)->type)){0} = (ptr))
+#else
+#define CHANNEL_OF_SEND_PTR(tc, ptr) (ptr)
+#define CHANNEL_OF_RECV_PTR(tc, ptr) (ptr)
+#endif
+#define channel_send_of(tc, ptr) channel_send(&(tc)->c, CHANNEL_OF_SEND_PTR(tc, ptr), sizeof (*(tc)->type))
+#define channel_try_send_of(tc, ptr) channel_try_send(&(tc)->c, CHANNEL_OF_SEND_PTR(tc, ptr), sizeof (*(tc)->type))
+#define channel_recv_of(tc, ptr) channel_recv(&(tc)->c, CHANNEL_OF_RECV_PTR(tc, ptr))
+#define channel_try_recv_of(tc, ptr) channel_try_recv(&(tc)->c, CHANNEL_OF_RECV_PTR(tc, ptr))
+#define channel_send_batch_of(tc, count, ptr) channel_send_batch(&(tc)->c, (count), CHANNEL_OF_SEND_PTR(tc, ptr), sizeof (*(tc)->type))
+#define channel_recv_batch_of(tc, count, ptr) channel_recv_batch(&(tc)->c, (count), CHANNEL_OF_RECV_PTR(tc, ptr), sizeof (*(tc)->type))
+
+/*
+ * Closes the channel and wakes every thread waiting on it, so none is left asleep.
+ * - Sends return 0 and their message is not sent. channel_send_batch returns the messages sent before.
+ * - Receives take what is still queued, then return 0.
+ * - Barriers return 0, selects return the closed case with a data_size of 0.
+ */
 void channel_close(channel c[static const restrict 1]);
+/*
+ * Drain then close: New sends return 0 right away, while messages already queued
+ * or waiting with a blocked sender are still received. The first receive to find nothing left
+ * in either direction closes the channel like channel_close. Returns without waiting for that.
+	channel_close_drain(&jobs);
+	while (channel_recv(&jobs, &job)) { ... } // Ends once every job was received.
+ */
+void channel_close_drain(channel c[static const restrict 1]);
 
 inline void channel_set_owner(channel c[static const restrict 1], const kernel_pid_t thread_id)
 { c->creator = thread_id; }
@@ -136,6 +281,67 @@ inline void channel_set_buffered(channel c[static const restrict 1], const bool
 { c->flags |= (buffered << (CHANNEL_BUFFERED - 1)); }
 inline bool channel_is_closed(channel c[static const restrict 1])
 { return (c->flags & CHANNEL_CLOSED); }
+// Closed or draining, either way no new messages go in, see channel_close_drain.
+inline bool channel_is_send_closed(const channel c[static const restrict 1])
+{ return (c->flags & (CHANNEL_CLOSED | CHANNEL_DRAINING)); }
+
+/*
+ * Multi-producer/multi-consumer: Every thread sends to and receives from the same file,
+ * the creator's send file, instead of the file of its side. Any number of threads may send and receive,
+ * each message goes to exactly one receiver, and waiting threads go in order of priority and then arrival.
+ * Call right after making the channel.
+	channel_make(&jobs, true);
+	channel_set_mpmc(&jobs);
+ */
+inline void channel_set_mpmc(channel c[static const restrict 1])
+{ c->flags |= CHANNEL_MPMC; }
+
+/*
+ * Single-producer/single-consumer: Exactly one thread or ISR sends and one receives per direction.
+ * With TSRB (USETSRB=1), channel_send, channel_recv and their try variants on a buffered channel
+ * then move messages through the ring without disabling interrupts,
+ * and only disable them to hand over to a thread waiting on the other side.
+ * Not for MPMC or coalesced channels, which keep taking the locked path.
+	channel_make(&samples, true);
+	channel_set_spsc(&samples);
+ */
+inline void channel_set_spsc(channel c[static const restrict 1])
+{ c->flags |= CHANNEL_SPSC; }
+
+/*
+ * Wakeup coalescing for buffered channels.
+ * A waiting receiver is only woken once high bytes or msgs messages are queued,
+ * and a waiting sender only once the buffer drains to low bytes or less.
+ * A sender about to wait for room always wakes the receiver first.
+ * Passing 0 for both high and msgs wakes on every message again, which is the default.
+	channel_set_watermarks(&c, 48, 8, 16);
+ */
+void channel_set_watermarks(channel c[static const restrict 1], const size_t high, const size_t msgs, const size_t low);
+/*
+ * Statistics, built with USESTATS=1 (CSP_STATS). Registered channels show up in the csp shell command.
+ * Without CSP_STATS, registering does nothing, so applications may register their channels either way.
+	channel_make(&samples, true);
+	channel_register(&samples, "samples");
+ */
+#ifdef CSP_STATS
+void channel_register(channel c[static const restrict 1], const char *name);
+void channel_unregister(channel c[static const restrict 1]);
+// The registered channel after prev, or the first one for a null prev.
+channel *channel_registered(const channel *prev);
+// A consistent copy of the counters, which keep counting from there.
+channel_stats channel_get_stats(const channel c[static const restrict 1]);
+void channel_reset_stats(channel c[static const restrict 1]);
+// Prints the counters of every registered channel, one line each, as the csp shell command does.
+void channel_print_stats(void);
+#else
+inline void channel_register(channel c[static const restrict 1], const char *const name)
+{ (void)c; (void)name; }
+inline void channel_unregister(channel c[static const restrict 1])
+{ (void)c; }
+#endif
+
+// Wakes the threads waiting on a coalesced channel, whatever is queued.
+void channel_flush(channel c[static const restrict 1]);
 
 // ch <- var
 size_t channel_send(channel c[static const restrict 1], const void *restrict data, size_t data_size);
@@ -149,42 +355,110 @@ channel_msg channel_recv_msg(channel c[static const restrict 1], void *const res
 
 size_t channel_drop(channel c[static const restrict 1]);
 
-// Selects the first linearly available channel of the channel array to send to.
+// Scatter/gather: One message gathered from, or scattered into, an iolist_t chain.
+// channel_recvv drops whatever part of the message does not fit the chain, and returns the bytes received.
+size_t channel_sendv(channel c[static const restrict 1], const iolist_t *const iolist);
+size_t channel_recvv(channel c[static const restrict 1], const iolist_t *const iolist);
+
+// Moves up to count messages of data_size bytes each, laid out back to back, in one critical section.
+// Waits until the first message can move, then moves as many as fit and wakes the other side once.
+// Returns the number of messages moved.
+size_t channel_send_batch(
+	channel c[static const restrict 1],
+	const size_t count,
+	const void *const restrict data,
+	const size_t data_size
+);
+// Receives up to count messages into slots of data_size bytes each, laid out back to back.
+// Waits until the first message arrives, stops early at a message bigger than a slot and leaves it on the channel.
+// Returns the number of messages received, 0 once closed or if the first message is bigger than a slot:
+// Take that one with channel_recv.
+size_t channel_recv_batch(
+	channel c[static const restrict 1],
+	const size_t count,
+	void *const restrict buffer,
+	const size_t data_size
+);
+
+/*
+ * Select over a mix of send and receive cases, like Go's select statement.
+ * Sleeps until one case can go ahead and takes exactly that one. Ready cases take turns.
+ * Cases on a closed channel are ready, and complete with data_size 0.
+ * So do sends of the wrong size for a fixed size channel, which channel_send refuses with 0.
+	channel_case cases[] = {
+		CHANNEL_CASE_RECV(&jobs, &job),
+		CHANNEL_CASE_SEND(&results, &result, sizeof (result)),
+	};
+	switch (channel_select(2, cases, false)) {
+		case 0: ... cases[0].data_size bytes received into job ...
+		case 1: ... result sent ...
+		default: ... Only with nonblocking, nothing was ready ...
+	}
+ */
+typedef struct channel_case channel_case;
+struct channel_case {
+	channel *c;
+	void *data;	 // Send: data to send. Receive: buffer to receive into.
+	size_t data_size;	 // Send: size to send. Receive: size received, set by channel_select.
+	bool send;
+
+	// Filled in by channel_select while it waits.
+	channel_waiter waiter;
+	iolist_t iolist;
+};
+#define CHANNEL_CASE_SEND(ch, ptr, size) ((channel_case){ .c = (ch), .data = (void *)(ptr), .data_size = (size), .send = true })
+#define CHANNEL_CASE_RECV(ch, ptr) ((channel_case){ .c = (ch), .data = (ptr), .send = false })
+
+// Returns the index of the case that went ahead.
+// With nonblocking, returns case_count if no case was ready, like a default case.
+size_t channel_select(const size_t case_count, channel_case cases[static const case_count], const bool nonblocking);
+
+#if IS_USED(MODULE_ZTIMER)
+/*
+ * Deadline bounded channel_send, channel_recv and channel_select, waiting at most timeout ticks of clock.
+ * Send and receive return 0 once the time is up. Messages only move whole,
+ * so then nothing of the message was sent or received, and the channel is left as it was.
+ * channel_select_timeout returns case_count once the time is up, like a timeout case.
+ * A timeout of 0 does not wait at all. channel_recv_timeout without a buffer drops the message.
+	if (!channel_recv_timeout(&c, &m, ZTIMER_MSEC, 100)) { ... No message within 100 ms ... }
+ */
+size_t channel_send_timeout(
+	channel c[static const restrict 1],
+	const void *const restrict data,
+	const size_t data_size,
+	ztimer_clock_t *const clock,
+	const uint32_t timeout
+);
+size_t channel_recv_timeout(
+	channel c[static const restrict 1],
+	void *const restrict buffer,
+	ztimer_clock_t *const clock,
+	const uint32_t timeout
+);
+size_t channel_select_timeout(
+	const size_t case_count,
+	channel_case cases[static const case_count],
+	ztimer_clock_t *const clock,
+	const uint32_t timeout
+);
+#endif
+
+// Sends the same data on whichever channel of the array can take it first, see channel_select.
 // Returns the index of the channel sent to.
-inline size_t channel_send_select(
+size_t channel_send_select(
 	const size_t channel_count,
 	channel *c[static const restrict channel_count],
 	const void *restrict data,
 	const size_t data_size
-)
-{
-	for (;;) {
-		for (size_t i = 0; i != channel_count; ++i) {
-			size_t send_size = channel_try_send(c[i], data, data_size);
-			if (send_size > 0) {
-				return i;
-			}
-		}
-	}
-}
+);
 
-// Selects the first linearly available channel to recieve data from.
-// Returns the index of the channel with data available to.
-inline size_t channel_recv_select(
+// Receives from whichever channel of the array has data first, see channel_select.
+// Returns the index of the channel received from.
+size_t channel_recv_select(
 	const size_t channel_count,
 	channel *c[static const restrict channel_count],
 	void *restrict data
-)
-{
-	for (;;) {
-		for (size_t i = 0; i != channel_count; ++i) {
-			size_t recv_size = channel_try_recv(c[i], data);
-			if (recv_size > 0) {
-				return i;
-			}
-		}
-	}
-}
+);
 
 // ptr = channel_recv(c, ptr);
 inline void *channel_recv_ptr(channel c[static const restrict 1], void *const buffer) {
@@ -195,6 +469,59 @@ inline void *channel_recv_ptr(channel c[static const restrict 1], void *const bu
 	return buffer;
 }
 
+/*
+ * Fixed block pool for zero-copy channels.
+ * The producer takes a block from the pool, fills it and sends only the pointer.
+ * Ownership moves with the pointer, and the receiver releases the block back to the pool when done.
+	CHANNEL_POOL_STATIC(packets, struct packet, 16);
+	channel_pool_make_static(packets);
+
+	struct packet *p = channel_pool_alloc(&packets);
+	channel_send_block(&c, p);
+	...
+	struct packet *p = channel_recv_block(&c);
+	channel_pool_free(&packets, p);
+ */
+typedef struct channel_pool channel_pool;
+struct channel_pool {
+	void *free;	 // Free blocks, linked through their first word.
+	size_t block_size;
+	size_t free_count;
+	list_node_t waiters;	 // Threads waiting for a block to be freed, as channel_waiter.
+};
+
+void channel_pool_init(
+	channel_pool p[static const restrict 1],
+	void *const restrict storage,
+	const size_t block_size,
+	const size_t block_count
+);
+
+// Takes a block from the pool, sleeping until one is freed if the pool is empty.
+// Returns nullptr if the pool is empty within an interrupt.
+void *channel_pool_alloc(channel_pool p[static const restrict 1]);
+// Takes a block from the pool, or returns nullptr if the pool is empty.
+void *channel_pool_try_alloc(channel_pool p[static const restrict 1]);
+// Returns a block to the pool and wakes a thread waiting for one.
+void channel_pool_free(channel_pool p[static const restrict 1], void *const restrict block);
+
+#define CHANNEL_POOL_STATIC(name, T, N) \
+	static union { T block; void *next; } name##_blocks[(N)]; \
+	static channel_pool name
+#define channel_pool_make_static(name) \
+	channel_pool_init(&(name), name##_blocks, sizeof (name##_blocks[0]), \
+		sizeof (name##_blocks) / sizeof (name##_blocks[0]))
+
+// Sends the block pointer, handing ownership of the block to the receiver.
+inline size_t channel_send_block(channel c[static const restrict 1], void *const block)
+{ return channel_send(c, &block, sizeof (block)); }
+// Receives a block pointer, the caller owns the block and frees it to its pool.
+inline void *channel_recv_block(channel c[static const restrict 1]) {
+	void *block = (void *)0;
+	channel_recv(c, &block);
+	return block;
+}
+
 #ifndef THREAD_STACKSIZE_CSP
 #define THREAD_STACKSIZE_CSP (THREAD_STACKSIZE_MINIMUM)
 #endif
@@ -227,6 +554,27 @@ typedef void *(*csp_func_t)(void *const args, void *const c);
 #endif
 
 typedef void *(*csp_func_param)(CSP_PARAM);
+
+/*
+ * Wait group: Counts processes, or any other work, yet to finish.
+ * csp_waitgroup_wait sleeps until the count is back to 0, woken exactly once by the last csp_waitgroup_done.
+ * Processes spawned with GO_WG or csp_obj_wg are added before they start and count themselves done when they return.
+	static csp_waitgroup wg = {0};
+	for (size_t i = 0; i != n; ++i) { GO_WG(&wg, worker, &jobs[i]); }
+	csp_waitgroup_wait(&wg);
+ */
+typedef struct csp_waitgroup csp_waitgroup;
+struct csp_waitgroup {
+	unsigned count;
+	list_node_t waiters;	 // Threads in csp_waitgroup_wait, as channel_waiter.
+};
+
+void csp_waitgroup_add(csp_waitgroup wg[static const restrict 1], const unsigned n);
+// Also from interrupts.
+void csp_waitgroup_done(csp_waitgroup wg[static const restrict 1]);
+// Returns false without waiting within an interrupt while the count is not 0.
+bool csp_waitgroup_wait(csp_waitgroup wg[static const restrict 1]);
+
 typedef struct csp_context csp_ctx;
 struct csp_context {
 	kernel_pid_t id;
@@ -238,12 +586,18 @@ struct csp_context {
 		channel *c;
 	} params;
 	void *retval;
+	list_node_t joiners;	 // Threads waiting in csp_join, as channel_waiter.
+	csp_waitgroup *wg;	 // Counted done on return, see GO_WG.
 	// size_t stack_size;
 	// char stack[THREAD_STACKSIZE_CSP];
 
 #if defined(CONFIG_THREAD_NAMES) || defined(DOXYGEN)
 	char name[CSP_NAME_LENGTH];
 #endif
+#ifdef CSP_SLAB
+	channel_pool *slab;	 // The size class the stack came from, nullptr for caller stacks.
+#endif
+	unsigned short waits;	 // Wait queues and timers the process is in, csp_kill leaves it alone while not 0.
 };
 
 enum CSP_FLAGS
@@ -251,9 +605,9 @@ enum CSP_FLAGS
 : short
 #endif
 {
-	CSP_STOP = (0 << 0),
+	CSP_STOP = (0 << 0),	 // No flag, the process stopped once CSP_RUNNING is cleared.
 	CSP_SKIP = (1 << 0),
-	CSP_RUNNING = (1 << 1),
+	CSP_RUNNING = (1 << 1),	 // Set until the process returned or was killed.
 
 	CSP_MAX = (1 << sizeof(short)),
 };
@@ -265,7 +619,7 @@ enum CSP_FLAGS
 
 // Copies the arguments to a local variable using memcpy, compound literal and type T.
 #if defined(__GNUC__) || defined(__clang__) || __has_builtin(__builtin_memcpy)
-extern void *memcpy(void *, const void *, unsigned);
+extern void *memcpy(void *, const void *, size_t);
 #define CSP_GET_ARGS_T(args, T) memcpy(&(T){0}, (args), sizeof(T))
 #else
 #define CSP_GET_ARGS_T(args, T)                       \
@@ -297,8 +651,8 @@ inline void *csp_ret(csp_ctx ctx[static const restrict 1])
 #define VA_NARGS(...) VA_NARGS_IMPL(__VA_ARGS__, 2, 1)
 #endif
 
-#define CSP_GET_ARGS_0(...) nullptr, nullptr
-#define CSP_GET_ARGS_1(_1, ...) nullptr, _1
+#define CSP_GET_ARGS_0(...) (void *)0, (void *)0
+#define CSP_GET_ARGS_1(_1, ...) (void *)0, _1
 #define CSP_GET_ARGS_2(_1, _2, ...) _2, _1
 #define CSP_GET_ARGS_3(_1, _2, _3, ...) \
 	_1, (void *[]) { _2, _3 }
@@ -307,9 +661,35 @@ inline void *csp_ret(csp_ctx ctx[static const restrict 1])
 #define CSP_GET_ARGS_(N, ...) CSP_GET_ARGS_##N(__VA_ARGS__)
 #define CSP_GET_ARGS(N, ...) CSP_GET_ARGS_(N, __VA_ARGS__)
 
+/*
+ * Stack slab, built with USESLAB=1 (CSP_SLAB): GO, GO_SIZ, csp and csp_sz take their stack from a pool
+ * of fixed size classes instead of storage per call site, and the stack goes back to its class once the process exits.
+ * So GO in a loop gets a stack per process, and the stacks in use are bounded by the processes running at once.
+ * A request takes the smallest class it fits, a larger one if that is used up, and waits for the smallest otherwise.
+ * The csp_ctx stays readable after the exit, until the next spawn reuses its stack.
+ * csp_obj and _csp with a stack of their own keep using that.
+ */
+#ifndef CSP_SLAB_SMALL_SIZE
+#define CSP_SLAB_SMALL_SIZE THREAD_STACKSIZE_CSP
+#endif
+#ifndef CSP_SLAB_SMALL_COUNT
+#define CSP_SLAB_SMALL_COUNT 4
+#endif
+#ifndef CSP_SLAB_LARGE_SIZE
+#define CSP_SLAB_LARGE_SIZE THREAD_STACKSIZE_DEFAULT
+#endif
+#ifndef CSP_SLAB_LARGE_COUNT
+#define CSP_SLAB_LARGE_COUNT 2
+#endif
+
 #define CSP_INIT_CTX \
 	(CSP_C23_CLIT_STORAGE csp_ctx) { 0 }
+#ifdef CSP_SLAB
+// No stack, _csp takes one of at least sz bytes from the slab.
+#define CSP_INIT(sz) ((struct csp_stack){(char *)0, sz})
+#else
 #define CSP_INIT(sz) ((struct csp_stack){(CSP_C23_CLIT_STORAGE char[sz]){0}, sz})
+#endif
 
 /*
  * Convenience macro to emulate Golangs version of a Go function.
@@ -354,6 +734,9 @@ inline void *csp_ret(csp_ctx ctx[static const restrict 1])
 #define csp(func, channel, args) _csp(CSP_INIT(THREAD_STACKSIZE_CSP), (csp_func_param)(func), (channel), (args))
 #define csp_sz(sz, func, channel, args) _csp(CSP_INIT(sz), ((csp_func_param)(func)), (channel), (args))
 #define csp_obj(obj, func, channel, args) _csp((csp_stack){(obj), sizeof (obj)}, ((csp_func_param)(func)), (channel), (args))
+// GO and csp_obj counted in the wait group wg, see csp_waitgroup.
+#define GO_WG(wg, func, ...) _csp_wg((wg), CSP_INIT(THREAD_STACKSIZE_CSP), ((csp_func_param)(func)), CSP_GET_ARGS(VA_NARGS(__VA_ARGS__), __VA_ARGS__))
+#define csp_obj_wg(wg, obj, func, channel, args) _csp_wg((wg), (csp_stack){(obj), sizeof (obj)}, ((csp_func_param)(func)), (channel), (args))
 
 // Initialize an object of type csp_ctx. Adds any channels and args to it. Will pass on channels and args.
 csp_ctx *_csp(
@@ -361,12 +744,92 @@ csp_ctx *_csp(
 	csp_func_param f,
 	channel *const restrict c,
 	void *const restrict args);
+// _csp, adding the process to wg before it starts.
+csp_ctx *_csp_wg(
+	csp_waitgroup *const wg,
+	struct csp_stack sp,
+	csp_func_param f,
+	channel *const restrict c,
+	void *const restrict args);
 
-/* Sets the csp ctx thread to zombie and kills it. Only the context will remain. */
+/* Sets the csp ctx thread to zombie and kills it. Only the context will remain.
+ * Returns 1 once killed, STATUS_NOT_FOUND for a process that returned or was killed before,
+ * 0 for a process waiting on a channel, a join, a wait group or a pool: Close the channel or the like to have it return. */
 int csp_kill(csp_ctx ctx[static const restrict 1]);
 bool csp_running(csp_ctx ctx[static const restrict 1]);
+
+/*
+ * Sleeps until the process returned, then fetches its return value into retval, if given.
+ * Any number of threads may join the same process, and joining one that already returned does not wait.
+ * Returns false without waiting within an interrupt while the process still runs.
+	void *result;
+	csp_join(GO(function, args), &result);
+ */
+bool csp_join(csp_ctx ctx[static const restrict 1], void **const retval);
+#if IS_USED(MODULE_ZTIMER)
+// csp_join waiting at most timeout ticks of clock. Returns false once the time is up, the process running on.
+bool csp_join_timeout(csp_ctx ctx[static const restrict 1], void **const retval, ztimer_clock_t *const clock, const uint32_t timeout);
+#endif
 inline void csp_wait(csp_ctx ctx[static const restrict 1])
-{ while (csp_running(ctx)) { } }
+{ csp_join(ctx, (void **)0); }
+
+/*
+ * Worker pool: worker_count threads made once, running submitted functions to completion one after another,
+ * so dispatching a task costs a channel send instead of a thread creation, and tasks are not capped by MAXTHREADS.
+ * Tasks wait in a queue, an MPMC channel of csp_task, and go to whichever worker is free first.
+ * Functions take the same arguments as with GO, and their return value is dropped: Send results over a channel.
+ * Arguments have to outlive the task, which may run after the submitter moved on.
+	CSP_POOL_STATIC(workers, 4, 16);
+	csp_pool_make_static(workers);
+	GO_POOL(&workers, function, args);
+	csp_pool_submit(&workers, function, c, args);
+	...
+	csp_pool_close(&workers); // Queued tasks still run, then the workers exit.
+ */
+typedef struct csp_task csp_task;
+struct csp_task {
+	csp_func_param proc;
+	struct csp_params params;
+};
+
+typedef struct csp_pool csp_pool;
+struct csp_pool {
+	channel queue;	 // Tasks, see channel_set_mpmc.
+	size_t workers;	 // Workers started.
+};
+
+// Starts worker_count workers on stack_size byte stacks laid out back to back in stacks,
+// taking tasks from a queue of queue_size bytes, rounded down to a power of two. Returns the number of workers started,
+// fewer once MAXTHREADS is reached.
+size_t csp_pool_init(
+	csp_pool p[static const restrict 1],
+	const size_t worker_count,
+	const size_t stack_size,
+	char stacks[static const worker_count * stack_size],
+	const size_t queue_size,
+	rb_buftype queue[static const queue_size]
+);
+
+// Queues a task, waiting for room in a full queue. Returns false once the pool is closed.
+bool csp_pool_submit(csp_pool p[static const restrict 1], csp_func_param f, channel *const c, void *const args);
+// Queues a task if there is room, also from an interrupt. Returns false if the queue is full or the pool closed.
+bool csp_pool_try_submit(csp_pool p[static const restrict 1], csp_func_param f, channel *const c, void *const args);
+// Refuses new tasks. The workers run the ones queued and exit.
+inline void csp_pool_close(csp_pool p[static const restrict 1])
+{ channel_close_drain(&p->queue); }
+
+// Declares a pool of workers threads on THREAD_STACKSIZE_CSP stacks, with a queue of at least tasks tasks.
+#define CSP_POOL_STATIC(name, workers, tasks) \
+	static char name##_stacks[(workers)][THREAD_STACKSIZE_CSP]; \
+	static _Alignas (csp_task) rb_buftype name##_tasks[RB_SIZE((tasks) * sizeof (csp_task))]; \
+	static csp_pool name
+#define csp_pool_make_static(name) \
+	csp_pool_init(&(name), sizeof (name##_stacks) / sizeof (name##_stacks[0]), sizeof (name##_stacks[0]), \
+		name##_stacks[0], sizeof (name##_tasks), name##_tasks)
+
+// GO on a pool worker, with the arguments of GO.
+#define GO_POOL(pool, func, ...) \
+	csp_pool_submit((pool), ((csp_func_param)(func)), CSP_GET_ARGS(VA_NARGS(__VA_ARGS__), __VA_ARGS__))
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     sys_csp
+ * @{
+ *
+ * @file csp_coro.h
+ * @brief       Coroutines: Many small processes multiplexed onto one RIOT thread, the carrier.
+ *				Built with USECORO=1 (CSP_CORO). A coroutine has a stack of its own but no thread_t,
+ *				so coroutines are only limited by RAM, not MAXTHREADS, and need no priority slot.
+ *				The carrier runs one coroutine at a time, each until it waits on a coroutine channel,
+ *				yields or returns, then switches to the next ready one in user space: No kernel scheduler,
+ *				no interrupts disabled. Coroutine channels are only for the coroutines of one carrier.
+ *				Anything else blocking, like a channel_send, blocks the whole carrier with every coroutine on it.
+ *
+ *				The context switch is swapcontext on native and a register push and stack swap on ARMv7-M and ARMv8-M Mainline.
+ *				On Cortex-M, interrupts preempting a coroutine stack their frame on it, so leave room for that.
+ *
+	static csp_carrier carrier;
+	static csp_coro_chan c;
+	static char stacks[100][CSP_CORO_STACKSIZE];
+	csp_coro_chan_make(&c, 0, nullptr);
+	for (size_t i = 0; i != 100; ++i) { csp_coro_obj(&carrier, stacks[i], worker, &c, nullptr); }
+	csp_carrier_run(&carrier); // Returns once every coroutine returned.
+ *
+ * @author      Jonathan L. Claudius <jaylcypher@github.com>
+ */
+
+#ifndef CSP_CORO_H
+#define CSP_CORO_H
+
+#include "csp.h"
+
+#ifdef CSP_CORO
+#ifdef CPU_NATIVE
+#include <ucontext.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stack of a coroutine, csp_coro included. Native needs room for the host libc, printf alone takes most of 8 KiB.
+#ifndef CSP_CORO_STACKSIZE
+#ifdef CPU_NATIVE
+#define CSP_CORO_STACKSIZE 16384
+#else
+#define CSP_CORO_STACKSIZE 512
+#endif
+#endif
+
+#if defined(CPU_NATIVE)
+typedef ucontext_t csp_coro_context;
+#elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+typedef void *csp_coro_context;	 // The saved stack pointer, the registers are on the stack.
+#else
+#error "No coroutine context switch for this CPU, see csp_coro.c"
+#endif
+
+typedef struct csp_coro csp_coro;
+typedef struct csp_carrier csp_carrier;
+
+// First in, first out, linked through the coroutines.
+typedef struct csp_coro_queue csp_coro_queue;
+struct csp_coro_queue {
+	csp_coro *head;
+	csp_coro *tail;
+};
+
+// Lives at the bottom of the coroutine's stack, like csp_ctx.
+struct csp_coro {
+	csp_coro *next;	 // In the ready queue of the carrier, or a wait queue of a channel.
+	csp_carrier *carrier;
+	csp_coro_context context;
+	csp_func_param proc;
+	struct csp_params params;
+	void *retval;
+	bool done;	 // Returned, retval is set.
+
+	// Waiting on a channel: Sender: data to send. Receiver: buffer to receive into.
+	void *data;
+	size_t data_size;	 // Sender: size to send. Receiver: size received.
+	bool handed;	 // Set by the other side once the message is copied.
+};
+
+struct csp_carrier {
+	csp_coro_queue ready;
+	csp_coro *current;	 // The coroutine running, nullptr in between.
+	csp_coro_context context;	 // Of csp_carrier_run, switched back to in between coroutines.
+	size_t coros;	 // Spawned and not yet returned.
+};
+
+// Adds a coroutine running f on the stack_size bytes of stack, the csp_coro at its bottom.
+// Arguments like _csp. From the carrier thread only, before or while it runs the carrier, also from a coroutine.
+// Returns nullptr for a stack too small.
+csp_coro *csp_coro_spawn(
+	csp_carrier carrier[static const restrict 1],
+	char *const stack,
+	const size_t stack_size,
+	csp_func_param f,
+	channel *const c,
+	void *const args
+);
+#define csp_coro_obj(carrier, obj, func, channel, args) \
+	csp_coro_spawn((carrier), (obj), sizeof (obj), ((csp_func_param)(func)), (channel), (args))
+
+// Runs the coroutines of the carrier on the calling thread, until none is ready.
+// Returns the number of coroutines left waiting, 0 once every one returned.
+size_t csp_carrier_run(csp_carrier carrier[static const restrict 1]);
+
+// The coroutine calling, nullptr outside of coroutines.
+csp_coro *csp_coro_self(void);
+// Lets the other ready coroutines of the carrier run first.
+void csp_coro_yield(void);
+
+/*
+ * Coroutine channel: A channel between the coroutines of one carrier, sized by caller storage like channel_make_buf.
+ * Size 0 is unbuffered, a send waits for the receiver. Messages bigger than the buffer go straight to a receiver.
+ * Sends and receives return the bytes moved, 0 once the channel is closed, like channel_send and channel_recv.
+ * Only coroutines can wait: Outside of one, a send or receive that would wait asserts, see csp_coro_self.
+ */
+typedef struct csp_coro_chan csp_coro_chan;
+struct csp_coro_chan {
+	csp_ring_t rb;	 // Queued messages, each with its size in front.
+	csp_coro_queue senders;	 // Senders waiting with a message.
+	csp_coro_queue receivers;	 // Receivers waiting for one.
+	bool closed;
+};
+
+// Uses the largest power of two of size bytes in buf.
+void csp_coro_chan_make(csp_coro_chan ch[static const restrict 1], const size_t size, void *const buf);
+size_t csp_coro_send(csp_coro_chan ch[static const restrict 1], const void *const data, const size_t data_size);
+size_t csp_coro_recv(csp_coro_chan ch[static const restrict 1], void *const buffer);
+// Wakes every coroutine waiting on the channel: Sends give up, receives take what is queued, then give up.
+void csp_coro_close(csp_coro_chan ch[static const restrict 1]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CSP_CORO */
+
+#endif /* CSP_CORO_H */
+/** @} */
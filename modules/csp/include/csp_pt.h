@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     sys_csp
+ * @{
+ *
+ * @file csp_pt.h
+ * @brief       Stackless processes: Resumable functions run by a dispatcher thread, all on its one stack.
+ *				A process costs its csp_pt and a case slot in the dispatcher instead of a thread and THREAD_STACKSIZE_CSP of stack,
+ *				for the many small state machines that spend their lives blocked on a channel.
+ *				The body is a switch on the line it last blocked at, like Contiki's protothreads: CSP_PT_SEND and CSP_PT_RECV
+ *				return to the dispatcher if the channel is not ready, and the next call jumps back behind them.
+ *				The dispatcher waits on the operations of every blocked process at once with channel_select,
+ *				so they work on any channel, with threads and interrupts on the other side.
+ *
+ *				Locals do not survive a blocking point, keep them in a struct around the csp_pt.
+ *				A blocking point cannot be inside a switch of your own, and the body must not block the dispatcher
+ *				in a plain channel_recv or the like: Every other process on it waits as well.
+ *
+	struct handler { csp_pt pt; struct packet *p; };
+	static int handler(csp_pt *pt)
+	{
+		struct handler *const h = container_of(pt, struct handler, pt);
+		CSP_PT_BEGIN(pt);
+		while (true) {
+			CSP_PT_RECV(pt, pt->params.c, &h->p);
+			if (!csp_pt_bytes(pt)) { break; } // Closed.
+			... use h->p ...
+		}
+		CSP_PT_END(pt);
+	}
+	CSP_PT_DISPATCHER_STATIC(handlers, 16);
+	csp_pt_dispatcher_make_static(handlers);
+	static struct handler h[16];
+	GO_PT(&handlers, &h[0].pt, handler, &c, nullptr);
+	...
+	csp_pt_dispatcher_close(&handlers); // Takes no more, the dispatcher exits once its processes did.
+ *
+ * @author      Jonathan L. Claudius <jaylcypher@github.com>
+ */
+
+#ifndef CSP_PT_H
+#define CSP_PT_H
+
+#include "csp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct csp_pt csp_pt;
+// Runs the process up to its next blocking point, see CSP_PT_BEGIN.
+typedef int (*csp_pt_func)(csp_pt *pt);
+
+enum {
+	CSP_PT_WAITING,	 // On the channel operation in the csp_pt.
+	CSP_PT_YIELDED,	 // Runs again once the others had their turn.
+	CSP_PT_EXITED,
+};
+
+struct csp_pt {
+	csp_pt_func f;	 // nullptr once exited.
+	struct csp_params params;	 // Like GO, for the body to use.
+	csp_pt *next;	 // Among the ready processes of the dispatcher.
+	unsigned short line;	 // Where to resume, 0 at the start.
+	bool send;
+
+	// The channel operation the process blocks on, like a channel_case.
+	channel *c;
+	void *data;
+	size_t data_size;	 // Send: size to send. Receive: size received.
+};
+
+#define CSP_PT_BEGIN(pt) switch ((pt)->line) { case 0:
+#define CSP_PT_END(pt) } (pt)->line = 0; return CSP_PT_EXITED
+#define CSP_PT_EXIT(pt) do { (pt)->line = 0; return CSP_PT_EXITED; } while (0)
+#define CSP_PT_YIELD(pt) \
+	do { (pt)->line = __LINE__; return CSP_PT_YIELDED; case __LINE__:; } while (0)
+
+// Blocking points: Send or receive like channel_send and channel_recv, csp_pt_bytes tells the bytes moved, 0 once closed.
+#define CSP_PT_WAIT(pt, ch, ptr, size, is_send) \
+	do { \
+		(pt)->c = (ch); \
+		(pt)->data = (void *)(ptr); \
+		(pt)->data_size = (size); \
+		(pt)->send = (is_send); \
+		(pt)->line = __LINE__; \
+		return CSP_PT_WAITING; \
+		case __LINE__:; \
+	} while (0)
+#define CSP_PT_SEND(pt, ch, ptr, size) CSP_PT_WAIT((pt), (ch), (ptr), (size), true)
+#define CSP_PT_RECV(pt, ch, ptr) CSP_PT_WAIT((pt), (ch), (ptr), 0, false)
+
+inline size_t csp_pt_bytes(const csp_pt pt[static const restrict 1])
+{ return pt->data_size; }
+// Spawned and not yet exited.
+inline bool csp_pt_running(const csp_pt pt[static const restrict 1])
+{ return pt->f; }
+
+typedef struct csp_pt_dispatcher csp_pt_dispatcher;
+struct csp_pt_dispatcher {
+	channel spawns;	 // New processes as csp_pt pointers, see channel_set_mpmc.
+	csp_pt *spawned;	 // Receives the spawns.
+	channel_case *cases;	 // Operation of each blocked process, then room for the spawns.
+	csp_pt **blocked;	 // Process of each case.
+	csp_pt *ready;	 // New and yielded processes, first in first out.
+	csp_pt *ready_last;
+	size_t waiting;	 // Blocked processes.
+	size_t count;	 // Processes taken and not yet exited.
+	size_t capacity;
+	kernel_pid_t pid;
+};
+
+// Starts a dispatcher thread for up to capacity processes, running them on the stack_size bytes of stack.
+// cases and blocked keep their blocked operations. Spawns wait in a queue of queue_size bytes, rounded down to a power of two.
+// Returns the pid of the dispatcher, or the error of thread_create.
+kernel_pid_t csp_pt_dispatcher_init(
+	csp_pt_dispatcher d[static const restrict 1],
+	const size_t capacity,
+	channel_case cases[static const capacity + 1],
+	csp_pt *blocked[static const capacity],
+	const size_t stack_size,
+	char stack[static const stack_size],
+	const size_t queue_size,
+	rb_buftype queue[static const queue_size]
+);
+
+// Hands pt, running f, to the dispatcher, waiting while the dispatcher is full. Returns false once it is closed.
+// From a process of the dispatcher itself it returns false rather than waiting.
+bool csp_pt_spawn(csp_pt_dispatcher d[static const restrict 1], csp_pt pt[static const restrict 1], csp_pt_func f, channel *const c, void *const args);
+// csp_pt_spawn if there is room in the queue, also from an interrupt.
+bool csp_pt_try_spawn(csp_pt_dispatcher d[static const restrict 1], csp_pt pt[static const restrict 1], csp_pt_func f, channel *const c, void *const args);
+// Takes no new processes. The dispatcher exits once the ones it has did.
+inline void csp_pt_dispatcher_close(csp_pt_dispatcher d[static const restrict 1])
+{ channel_close_drain(&d->spawns); }
+
+// Declares a dispatcher for up to procs processes on a THREAD_STACKSIZE_DEFAULT stack, shared by their bodies.
+#define CSP_PT_DISPATCHER_STATIC(name, procs) \
+	static channel_case name##_cases[(procs) + 1]; \
+	static csp_pt *name##_blocked[(procs)]; \
+	static char name##_stack[THREAD_STACKSIZE_DEFAULT]; \
+	static _Alignas (csp_pt *) rb_buftype name##_spawns[RB_SIZE((procs) * sizeof (csp_pt *))]; \
+	static csp_pt_dispatcher name
+#define csp_pt_dispatcher_make_static(name) \
+	csp_pt_dispatcher_init(&(name), sizeof (name##_blocked) / sizeof (name##_blocked[0]), name##_cases, name##_blocked, \
+		sizeof (name##_stack), name##_stack, sizeof (name##_spawns), name##_spawns)
+
+// GO for stackless processes: Spawns pt running func on the dispatcher, with the channel and arguments of csp.
+#define GO_PT(d, pt, func, channel, args) csp_pt_spawn((d), (pt), (func), (channel), (args))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CSP_PT_H */
+/** @} */
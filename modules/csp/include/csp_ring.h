@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     sys_csp
+ * @{
+ *
+ * @file csp_ring.h
+ * @brief       Ringbuffer behind CSP channels.
+ *				Power of two capacity with free running counters masked into the buffer,
+ *				so a transfer is at most two copies, one up to the wrap and one after it.
+ *				With TSRB, the counters are C11 atomics: The producer only moves writes and the consumer only moves reads,
+ *				with acquire/release ordering between them, so a single producer and consumer need no lock.
+ *				Without TSRB, the caller serializes access, like the channels do with the interrupts disabled.
+ *
+ * @author      Jonathan L. Claudius <jaylcypher@github.com>
+ */
+
+#ifndef CSP_RING_H
+#define CSP_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#ifdef TSRB
+#include <stdatomic.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef TSRB
+typedef atomic_uint csp_ring_counter;
+#define CSP_RING_LOAD(counter, order) atomic_load_explicit(&(counter), memory_order_##order)
+#define CSP_RING_STORE(counter, value, order) atomic_store_explicit(&(counter), (value), memory_order_##order)
+#else
+typedef unsigned csp_ring_counter;
+#define CSP_RING_LOAD(counter, order) (counter)
+#define CSP_RING_STORE(counter, value, order) ((counter) = (value))
+#endif
+
+typedef struct csp_ring csp_ring_t;
+struct csp_ring {
+	unsigned char *buf;
+	unsigned size;	 // Capacity in bytes, a power of two.
+	csp_ring_counter reads;	 // Bytes taken out so far, only moved by the consumer.
+	csp_ring_counter writes;	 // Bytes put in so far, only moved by the producer.
+};
+
+#define CSP_RING_INIT(buf) { (buf), sizeof (buf), 0, 0 }
+
+// The smallest power of two holding n bytes, as a constant expression for sizing storage.
+#define CSP_RING_SIZE(n) (CSP_RING_SMEAR_((unsigned long)(n) - 1) + 1)
+#define CSP_RING_SMEAR_(x) CSP_RING_SMEAR16_(CSP_RING_SMEAR4_(x))
+#define CSP_RING_SMEAR4_(x) ((x) | (x) >> 1 | (x) >> 2 | (x) >> 3)
+#define CSP_RING_SMEAR16_(x) ((x) | (x) >> 4 | (x) >> 8 | (x) >> 12 | (x) >> 16 | (x) >> 20 | (x) >> 24 | (x) >> 28)
+
+// Uses the largest power of two of size bytes in buf.
+void csp_ring_init(csp_ring_t rb[static const 1], void *buf, unsigned size);
+
+// Producer: Copies as much of data as there is room for, and publishes it to the consumer at once.
+unsigned csp_ring_add(csp_ring_t rb[static const 1], const void *data, unsigned n);
+int csp_ring_add_one(csp_ring_t rb[static const 1], unsigned char c);
+// Producer: Copies data offset bytes past the published end without publishing it.
+// Lets a message be put together from several parts and published as one, see csp_ring_publish.
+void csp_ring_put(csp_ring_t rb[static const 1], unsigned offset, const void *data, unsigned n);
+void csp_ring_publish(csp_ring_t rb[static const 1], unsigned n);
+
+// Consumer: Takes up to n bytes out into data.
+unsigned csp_ring_get(csp_ring_t rb[static const 1], void *data, unsigned n);
+unsigned csp_ring_drop(csp_ring_t rb[static const 1], unsigned n);
+unsigned csp_ring_peek(const csp_ring_t rb[static const 1], void *data, unsigned n);
+int csp_ring_peek_one(const csp_ring_t rb[static const 1]);
+
+// Bytes queued. The consumer can take at least this many.
+static inline unsigned csp_ring_used(const csp_ring_t rb[static const 1])
+{ return CSP_RING_LOAD(rb->writes, acquire) - CSP_RING_LOAD(rb->reads, acquire); }
+
+// Bytes of room. The producer can put at least this many.
+static inline unsigned csp_ring_free(const csp_ring_t rb[static const 1])
+{ return rb->size - csp_ring_used(rb); }
+
+static inline bool csp_ring_empty(const csp_ring_t rb[static const 1])
+{ return !csp_ring_used(rb); }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CSP_RING_H */
+/** @} */
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     sys_csp
+ * @{
+ *
+ * @file csp_trace.h
+ * @brief       Event trace of the CSP processes and channels.
+ *				Built with USETRACE=1 (CSP_TRACE), csp.c records spawns, exits, sends, receives,
+ *				sleeps, wakeups and closes into a fixed ring of binary events, the oldest overwritten first.
+ *				Recording disables interrupts around a clock read, a masked index increment and one event store.
+ *				The clock read is ztimer_now by default, a call into the timer driver that costs more than the rest,
+ *				so define CSP_TRACE_NOW to a cycle counter before leaving the trace on in soak tests.
+ *				csp_trace_write turns the ring into Chrome trace JSON, for chrome://tracing or ui.perfetto.dev.
+ *				Without CSP_TRACE, every trace point compiles to nothing.
+ *
+ * @author      Jonathan L. Claudius <jaylcypher@github.com>
+ */
+
+#ifndef CSP_TRACE_H
+#define CSP_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "irq.h"
+#include "kernel_defines.h"
+#include "thread.h"
+#if IS_USED(MODULE_ZTIMER_USEC)
+#include "ztimer.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	CSP_TRACE_SPAWN,	 // obj: The csp_ctx, csp_pool of a worker, or csp_pt or csp_pt_dispatcher, arg: Pid of the new process or the dispatcher.
+	CSP_TRACE_EXIT,	 // obj: The csp_ctx, csp_pool of a worker, or csp_pt or csp_pt_dispatcher.
+	CSP_TRACE_SEND_START,	 // obj: The channel, arg: Bytes to send.
+	CSP_TRACE_SEND_END,	 // obj: The channel, arg: Bytes sent.
+	CSP_TRACE_RECV_START,	 // obj: The channel.
+	CSP_TRACE_RECV_END,	 // obj: The channel, arg: Bytes received.
+	CSP_TRACE_SCHED_SELF,	 // Went to sleep, waiting on the send or receive around it.
+	CSP_TRACE_SCHED_OTHER,	 // arg: Pid of the woken thread.
+	CSP_TRACE_CLOSE,	 // obj: The channel.
+} csp_trace_kind;
+
+typedef struct csp_trace_event csp_trace_event;
+struct csp_trace_event {
+	uint32_t time;	 // CSP_TRACE_NOW, microseconds with ztimer_usec.
+	uint32_t arg;
+	const void *obj;
+	kernel_pid_t pid;	 // Who recorded it.
+	uint8_t kind;	 // csp_trace_kind
+};
+
+#ifdef CSP_TRACE
+// Events kept, a power of two.
+#ifndef CSP_TRACE_SIZE
+#define CSP_TRACE_SIZE 256
+#endif
+_Static_assert(!(CSP_TRACE_SIZE & (CSP_TRACE_SIZE - 1)), "CSP_TRACE_SIZE has to be a power of two");
+
+// Timestamp of an event. Define it to a cycle counter for a cheaper, finer clock, like DWT->CYCCNT on Cortex-M3 and up
+// once the DWT is enabled. The JSON then counts cycles where it says microseconds.
+#ifndef CSP_TRACE_NOW
+#if IS_USED(MODULE_ZTIMER_USEC)
+#define CSP_TRACE_NOW() ztimer_now(ZTIMER_USEC)
+#else
+// No clock, the index still orders the events.
+#define CSP_TRACE_NOW() csp_trace_next
+#endif
+#endif
+
+extern csp_trace_event csp_trace_ring[CSP_TRACE_SIZE];
+extern unsigned csp_trace_next;	 // Events recorded so far, masked into the ring.
+
+static inline void csp_trace(const csp_trace_kind kind, const void *const obj, const uint32_t arg)
+{
+	const unsigned state = irq_disable();
+	csp_trace_ring[csp_trace_next & (CSP_TRACE_SIZE - 1)] = (csp_trace_event){ CSP_TRACE_NOW(), arg, obj, thread_getpid(), kind };
+	++csp_trace_next;
+	irq_restore(state);
+}
+
+// Records an end event for the bytes a call returns, and returns them.
+static inline size_t csp_trace_end(const csp_trace_kind kind, const void *const obj, const size_t bytes)
+{
+	csp_trace(kind, obj, (uint32_t)bytes);
+	return bytes;
+}
+
+// Writes the events in the ring, oldest first, as Chrome trace JSON.
+void csp_trace_write(FILE *out);
+// Forgets every event recorded so far.
+void csp_trace_clear(void);
+#ifdef CPU_NATIVE
+// Writes the trace JSON to the file at path on the host, returns 0 or -errno.
+int csp_trace_dump(const char *path);
+#endif
+#else
+#define csp_trace(kind, obj, arg) ((void)0)
+#define csp_trace_end(kind, obj, bytes) (bytes)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CSP_TRACE_H */
+/** @} */